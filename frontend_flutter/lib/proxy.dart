@@ -123,6 +123,16 @@ class PrinterProxyCubit {
     sendMessage(message);
   }
 
+  void cancelUpload(String deviceId, int uploadId) {
+    final message = PrinterProxyMessage(type: MessageType.set, id: deviceId, content: {'property': 'cancel_upload', 'value': uploadId});
+    sendMessage(message);
+  }
+
+  void forceUpload(String deviceId, int uploadId) {
+    final message = PrinterProxyMessage(type: MessageType.set, id: deviceId, content: {'property': 'force_upload', 'value': uploadId});
+    sendMessage(message);
+  }
+
   void _onMessage(dynamic data) {
     if (_disposed) return;
 
@@ -133,6 +143,9 @@ class PrinterProxyCubit {
       switch (message.type) {
         case MessageType.init:
           break;
+        case MessageType.snapshot:
+          _onSnapshot(message.content!);
+          break;
         case MessageType.set:
           break;
         case MessageType.state:
@@ -154,6 +167,26 @@ class PrinterProxyCubit {
     } catch (e) {}
   }
 
+  void _onSnapshot(Map<String, dynamic> snapshot) {
+    final Map<String, dynamic> printers = snapshot['printers'] ?? {};
+
+    for (final entry in printers.entries) {
+      final printer = entry.value as Map<String, dynamic>;
+
+      try {
+        onStateChanged[entry.key]?.call(printer['state'] != null ? PrinterState.fromJson(printer['state']) : null);
+      } catch (e) {
+        onStateChanged[entry.key]?.call(null);
+      }
+
+      try {
+        onUploadChanged[entry.key]?.call(printer['upload'] != null ? PrinterStorageUploadState.fromJson(printer['upload']) : null);
+      } catch (e) {
+        onUploadChanged[entry.key]?.call(null);
+      }
+    }
+  }
+
   void _onError(error) {
     if (_disposed) return;
 
@@ -209,4 +242,12 @@ class PrinterStorageUploadStateCubit extends Cubit<PrinterStorageUploadState?> {
   void onNewState(PrinterStorageUploadState? state) {
     emit(state);
   }
+
+  void cancel(int uploadId) {
+    proxy.cancelUpload(deviceId, uploadId);
+  }
+
+  void force(int uploadId) {
+    proxy.forceUpload(deviceId, uploadId);
+  }
 }
@@ -8,6 +8,7 @@ import 'device.dart';
 
 enum MessageType {
   init('init'),
+  snapshot('snapshot'),
   state('state'),
   upload('upload'),
   set('set');
@@ -19,6 +20,8 @@ enum MessageType {
     switch (type) {
       case 'init':
         return MessageType.init;
+      case 'snapshot':
+        return MessageType.snapshot;
       case 'state':
         return MessageType.state;
       case 'upload':
@@ -90,6 +93,7 @@ class PrintState {
   final int layer;
   final double height;
   final PrintStatus status;
+  final int? remainingSeconds;
 
   PrintState({
     required this.filename,
@@ -99,6 +103,7 @@ class PrintState {
     required this.layer,
     required this.height,
     required this.status,
+    this.remainingSeconds,
   });
 
   factory PrintState.fromJson(Map<String, dynamic> json) {
@@ -110,6 +115,7 @@ class PrintState {
       layer: json['layer'] ?? 0,
       height: (json['height'] ?? 0.0).toDouble(),
       status: PrintStatus.fromString(json['status'] ?? 'busy'),
+      remainingSeconds: json['remaining'],
     );
   }
 }
@@ -206,7 +212,9 @@ class HistoryEntry {
 }
 
 enum PrinterStorageUploadStatus {
+  queued('Queued'),
   sending('Sending'),
+  retrying('Retrying'),
   success('Success'),
   failure('Failure');
 
@@ -215,8 +223,12 @@ enum PrinterStorageUploadStatus {
 
   static PrinterStorageUploadStatus fromString(String value) {
     switch (value.toLowerCase()) {
+      case 'queued':
+        return PrinterStorageUploadStatus.queued;
       case 'sending':
         return PrinterStorageUploadStatus.sending;
+      case 'retrying':
+        return PrinterStorageUploadStatus.retrying;
       case 'success':
         return PrinterStorageUploadStatus.success;
       case 'failure':
@@ -234,26 +246,59 @@ enum PrinterStorageUploadStatus {
   static PrinterStorageUploadStatus fromJson(String value) => fromString(value);
 }
 
+class PrinterStorageQueuedUpload {
+  int id;
+  String filename;
+  int position;
+  bool force;
+
+  PrinterStorageQueuedUpload({required this.id, required this.filename, required this.position, this.force = false});
+
+  factory PrinterStorageQueuedUpload.fromJson(Map<String, dynamic> json) {
+    return PrinterStorageQueuedUpload(
+      id: json['id'] ?? 0,
+      filename: json['filename'] ?? '',
+      position: json['position'] ?? 0,
+      force: json['force'] ?? false,
+    );
+  }
+}
+
 class PrinterStorageUploadState {
+  int id;
   int current;
   int target;
   String filename;
   PrinterStorageUploadStatus status;
+  int attempt;
+  int attempts;
+  String? error;
+  List<PrinterStorageQueuedUpload> queue;
 
   PrinterStorageUploadState({
+    this.id = 0,
     required this.filename,
     this.current = 0,
     this.target = 0,
     this.status = PrinterStorageUploadStatus.sending, // default
+    this.attempt = 1,
+    this.attempts = 1,
+    this.error,
+    this.queue = const [],
   });
 
   // Factory to construct from JSON
   factory PrinterStorageUploadState.fromJson(Map<String, dynamic> json) {
     return PrinterStorageUploadState(
+      id: json['id'] ?? 0,
       filename: json['filename'] ?? '',
       current: json['current'] ?? 0,
       target: json['target'] ?? 0,
       status: json['status'] != null ? PrinterStorageUploadStatus.fromJson(json['status']) : PrinterStorageUploadStatus.sending,
+      attempt: json['attempt'] ?? 1,
+      attempts: json['attempts'] ?? 1,
+      error: json['error'],
+      queue: (json['queue'] as List<dynamic>? ?? []).map((e) => PrinterStorageQueuedUpload.fromJson(e)).toList(),
     );
   }
 }
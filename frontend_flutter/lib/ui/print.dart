@@ -32,7 +32,11 @@ class PrintCardContent extends StatelessWidget {
                 children: [
                   Column(
                     crossAxisAlignment: CrossAxisAlignment.start,
-                    children: [Text(state.filename).semiBold, const SizedBox(height: 16), Text(state.status.name)],
+                    children: [
+                      Text(state.filename).semiBold,
+                      const SizedBox(height: 16),
+                      Text(state.remainingSeconds != null ? '${state.status.name}, ${Duration(seconds: state.remainingSeconds!).toString().split('.').first} left' : state.status.name),
+                    ],
                   ),
                   Column(
                     crossAxisAlignment: CrossAxisAlignment.start,
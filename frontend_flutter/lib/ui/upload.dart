@@ -18,8 +18,19 @@ class UploadToastWidget extends BlocWidget<PrinterStorageUploadState?> {
 
 class UploadCardContent extends StatelessWidget {
   final PrinterStorageUploadState state;
+  final PrinterStorageUploadStateCubit? cubit;
 
-  const UploadCardContent({super.key, required this.state});
+  const UploadCardContent({super.key, required this.state, this.cubit});
+
+  Widget _buildQueued(int id, String label, bool force) {
+    return Row(
+      children: [
+        Expanded(child: Text(label)),
+        if (!force) Button(style: ButtonVariance.ghost, onPressed: () => cubit?.force(id), child: const Text('Start now')),
+        Button(style: ButtonVariance.ghost, onPressed: () => cubit?.cancel(id), child: const Text('Cancel')),
+      ],
+    );
+  }
 
   @override
   Widget build(BuildContext context) {
@@ -48,6 +59,24 @@ class UploadCardContent extends StatelessWidget {
                     ),
                     const SizedBox(height: 16),
                     SizedBox(width: progressWidth, child: Progress(progress: percent.toDouble(), min: 0.0, max: 100.0)),
+                    if (state.attempt > 1 || state.status == PrinterStorageUploadStatus.retrying) ...[
+                      const SizedBox(height: 8),
+                      Text(state.status == PrinterStorageUploadStatus.retrying
+                          ? 'Retrying after attempt ${state.attempt}/${state.attempts} failed: ${state.error ?? ''}'
+                          : 'Attempt ${state.attempt}/${state.attempts}, last error: ${state.error ?? ''}'),
+                    ],
+                    if (state.status == PrinterStorageUploadStatus.sending || state.status == PrinterStorageUploadStatus.retrying) ...[
+                      const SizedBox(height: 8),
+                      Button(style: ButtonVariance.ghost, onPressed: () => cubit?.cancel(state.id), child: const Text('Cancel')),
+                    ],
+                    if (state.status == PrinterStorageUploadStatus.queued) ...[
+                      const SizedBox(height: 8),
+                      _buildQueued(state.id, 'Waiting for the print to finish', false),
+                    ],
+                    for (final queued in state.queue) ...[
+                      const SizedBox(height: 8),
+                      _buildQueued(queued.id, '${queued.position}. ${queued.filename}', queued.force),
+                    ],
                   ],
                 ),
               ],
@@ -60,7 +89,7 @@ class UploadCardContent extends StatelessWidget {
     return BlocListener<Cubit<PrinterStorageUploadState?>, PrinterStorageUploadState?>(
       listenWhen: (prev, curr) => prev?.status != curr?.status,
       listener: (context, state) {
-        if (state?.status != null && state?.status != PrinterStorageUploadStatus.sending) {
+        if (state?.status != null && state?.status != PrinterStorageUploadStatus.queued && state?.status != PrinterStorageUploadStatus.sending && state?.status != PrinterStorageUploadStatus.retrying) {
           showToast(context: context, builder: (ctx, overlay) => _buildToast(ctx, overlay, state?.status ?? PrinterStorageUploadStatus.failure));
         }
       },
@@ -92,7 +121,7 @@ class PrinterUploadCard extends CubitWidget<PrinterStorageUploadStateCubit, Prin
   Widget buildFromState(BuildContext context, PrinterStorageUploadState? state) {
     return PrinterCard(
       title: state != null ? 'Upload - ${state.filename}' : 'Upload',
-      child: state != null ? UploadCardContent(state: state) : MessageCardContent('Network is quiet'),
+      child: state != null ? UploadCardContent(state: state, cubit: getCubit()) : MessageCardContent('Network is quiet'),
     );
   }
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "pch/std.hpp"
+#include "core/persistence.hpp"
 
 struct Config {
 	static std::int64_t LogChat;
@@ -10,4 +11,15 @@ struct Config {
 	static bool LogIsEnabled;
 
 	static std::string FrontentPath;
+
+	static inline PersistenceSyncPolicy PersistenceSync = PersistenceSyncPolicy::File;
+
+	// Shared by uploads to all printers in bytes per second, zero means unlimited
+	static inline std::size_t UploadGlobalRate = 0;
+	static inline std::size_t UploadGlobalBurst = 0;
+
+	// Lossy rewrite of uploaded G-code so less goes over the printer link, see GCodeCompactor
+	static inline bool CompactGCode = false;
+	// Max deviation in mm of G2/G3 replacing runs of G1 moves, zero turns arc fitting off, see GCodeArcFitter
+	static inline double ArcTolerance = 0;
 };
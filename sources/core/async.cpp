@@ -1,4 +1,22 @@
 #include "async.hpp"
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <atomic>
+#include <algorithm>
+#include <thread>
+#include "core/perf.hpp"
+
+DEFINE_LOG_CATEGORY(Async)
+
+static boost::asio::thread_pool &Workers() {
+	// Keep a core for io thread, files processing is rare enough to not need more than a few
+	static boost::asio::thread_pool s_Workers(std::clamp(std::max(std::thread::hardware_concurrency(), 2u) - 1, 1u, 4u));
+
+	return s_Workers;
+}
+
+static std::atomic<std::int64_t> s_WorkerQueueDepth = 0;
 
 boost::asio::io_context& Async::Context(){
 	static boost::asio::io_context s_Context;
@@ -8,3 +26,24 @@ boost::asio::io_context& Async::Context(){
 void Async::Run() {
 	Context().run();
 }
+
+void Async::Offload(std::function<void()> task, std::function<void()> completion) {
+	std::int64_t depth = ++s_WorkerQueueDepth;
+	LogAsync(Verbose, "Worker queue depth is %", depth);
+
+	auto work = boost::asio::make_work_guard(Context());
+
+	boost::asio::post(Workers(), [task = std::move(task), completion = std::move(completion), work = std::move(work)]()mutable {
+		try{
+			PROFILE_SCOPE(Async, WorkerTask);
+			task();
+		}catch (const std::exception &e) {
+			LogAsync(Error, "Worker task failed: %", e.what());
+		}
+
+		s_WorkerQueueDepth--;
+
+		boost::asio::post(work.get_executor(), std::move(completion));
+		work.reset();
+	});
+}
\ No newline at end of file
@@ -1,9 +1,13 @@
 #pragma once
 
 #include "pch/asio.hpp"
+#include <functional>
 
 namespace Async{
 extern boost::asio::io_context &Context();
 
 extern void Run();
+
+// Runs task on the worker pool, completion is then posted back to Context()
+extern void Offload(std::function<void()> task, std::function<void()> completion);
 }
\ No newline at end of file
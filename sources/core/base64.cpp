@@ -7,16 +7,20 @@ std::string Base64::Encode(const std::string& in)
         return "";
     }
     
-    size_t max_output_size = ((in.size() + 2) / 3) * 4;
+    std::string out(EncodedSize(in.size()), '\0');
     
-    std::string out(max_output_size, '\0');
-    size_t outlen = 0;
+    out.resize(Encode(in.data(), in.size(), &out[0]));
     
-    base64_encode(in.c_str(), in.size(), &out[0], &outlen, 0);
+    return out;
+}
+
+std::size_t Base64::Encode(const void* data, std::size_t size, char* out)
+{
+    size_t outlen = 0;
     
-    out.resize(outlen);
+    base64_encode((const char*)data, size, out, &outlen, 0);
     
-    return out;
+    return outlen;
 }
 
 std::string Base64::Decode(const std::string& in)
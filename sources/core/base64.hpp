@@ -6,5 +6,12 @@ struct Base64 {
 
 	static std::string Encode(const std::string &in);
 
+	static constexpr std::size_t EncodedSize(std::size_t size) {
+		return (size + 2) / 3 * 4;
+	}
+
+	// Writes into caller's buffer of at least EncodedSize(size) bytes, returns how many were written
+	static std::size_t Encode(const void *data, std::size_t size, char *out);
+
 	static std::string Decode(const std::string &in);
 };
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "hash.hpp"
+#include <boost/endian/conversion.hpp>
+#include <cstring>
+#include <fstream>
+
+static constexpr std::uint64_t Prime1 = 0x9E3779B185EBCA87ull;
+static constexpr std::uint64_t Prime2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr std::uint64_t Prime3 = 0x165667B19E3779F9ull;
+static constexpr std::uint64_t Prime4 = 0x85EBCA77C2B2AE63ull;
+static constexpr std::uint64_t Prime5 = 0x27D4EB2F165667C5ull;
+
+static std::uint64_t RotateLeft(std::uint64_t value, int bits) {
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static std::uint64_t Read64(const std::uint8_t *data) {
+	std::uint64_t value;
+	std::memcpy(&value, data, sizeof(value));
+	return boost::endian::little_to_native(value);
+}
+
+static std::uint32_t Read32(const std::uint8_t *data) {
+	std::uint32_t value;
+	std::memcpy(&value, data, sizeof(value));
+	return boost::endian::little_to_native(value);
+}
+
+static std::uint64_t Round(std::uint64_t accumulator, std::uint64_t input) {
+	accumulator += input * Prime2;
+	accumulator = RotateLeft(accumulator, 31);
+	return accumulator * Prime1;
+}
+
+static std::uint64_t MergeRound(std::uint64_t accumulator, std::uint64_t value) {
+	accumulator ^= Round(0, value);
+	return accumulator * Prime1 + Prime4;
+}
+
+ContentHasher::ContentHasher(std::uint64_t seed):
+	m_Accumulators{seed + Prime1 + Prime2, seed + Prime2, seed, seed - Prime1},
+	m_Seed(seed)
+{}
+
+void ContentHasher::Update(std::string_view data) {
+	const std::uint8_t *input = reinterpret_cast<const std::uint8_t*>(data.data());
+	const std::uint8_t *end = input + data.size();
+
+	m_TotalSize += data.size();
+
+	if (m_BufferSize + data.size() < sizeof(m_Buffer)) {
+		std::memcpy(m_Buffer + m_BufferSize, input, data.size());
+		m_BufferSize += data.size();
+		return;
+	}
+
+	if (m_BufferSize) {
+		std::size_t fill = sizeof(m_Buffer) - m_BufferSize;
+		std::memcpy(m_Buffer + m_BufferSize, input, fill);
+		input += fill;
+
+		for(int i = 0; i < 4; i++)
+			m_Accumulators[i] = Round(m_Accumulators[i], Read64(m_Buffer + i * 8));
+
+		m_BufferSize = 0;
+	}
+
+	// Hot loop, 4 independent lanes of 8 bytes
+	std::uint64_t v1 = m_Accumulators[0], v2 = m_Accumulators[1], v3 = m_Accumulators[2], v4 = m_Accumulators[3];
+
+	while (end - input >= 32) {
+		v1 = Round(v1, Read64(input));
+		v2 = Round(v2, Read64(input + 8));
+		v3 = Round(v3, Read64(input + 16));
+		v4 = Round(v4, Read64(input + 24));
+		input += 32;
+	}
+
+	m_Accumulators[0] = v1; m_Accumulators[1] = v2; m_Accumulators[2] = v3; m_Accumulators[3] = v4;
+
+	m_BufferSize = end - input;
+	std::memcpy(m_Buffer, input, m_BufferSize);
+}
+
+std::uint64_t ContentHasher::Digest() const {
+	std::uint64_t hash = 0;
+
+	if (m_TotalSize >= sizeof(m_Buffer)) {
+		const std::uint64_t *v = m_Accumulators;
+
+		hash = RotateLeft(v[0], 1) + RotateLeft(v[1], 7) + RotateLeft(v[2], 12) + RotateLeft(v[3], 18);
+
+		for(int i = 0; i < 4; i++)
+			hash = MergeRound(hash, v[i]);
+	} else {
+		hash = m_Seed + Prime5;
+	}
+
+	hash += m_TotalSize;
+
+	const std::uint8_t *input = m_Buffer;
+	const std::uint8_t *end = m_Buffer + m_BufferSize;
+
+	while (end - input >= 8) {
+		hash ^= Round(0, Read64(input));
+		hash = RotateLeft(hash, 27) * Prime1 + Prime4;
+		input += 8;
+	}
+
+	if (end - input >= 4) {
+		hash ^= std::uint64_t(Read32(input)) * Prime1;
+		hash = RotateLeft(hash, 23) * Prime2 + Prime3;
+		input += 4;
+	}
+
+	while (input < end) {
+		hash ^= (*input) * Prime5;
+		hash = RotateLeft(hash, 11) * Prime1;
+		input++;
+	}
+
+	hash ^= hash >> 33;
+	hash *= Prime2;
+	hash ^= hash >> 29;
+	hash *= Prime3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+std::uint64_t ContentHasher::Hash(std::string_view data, std::uint64_t seed) {
+	ContentHasher hasher(seed);
+	hasher.Update(data);
+	return hasher.Digest();
+}
+
+std::optional<std::uint64_t> ContentHasher::HashFile(const std::filesystem::path &path, std::uint64_t seed) {
+	static constexpr std::size_t ChunkSize = 1024 * 1024;
+
+	std::ifstream file(path, std::ios::binary);
+
+	if(!file.is_open())
+		return std::nullopt;
+
+	ContentHasher hasher(seed);
+	std::vector<char> chunk(ChunkSize);
+
+	while (file.read(chunk.data(), chunk.size()) || file.gcount())
+		hasher.Update(std::string_view(chunk.data(), file.gcount()));
+
+	if(file.bad())
+		return std::nullopt;
+
+	return hasher.Digest();
+}
\ No newline at end of file
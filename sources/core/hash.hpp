@@ -0,0 +1,28 @@
+#pragma once
+
+#include "pch/std.hpp"
+#include <cstdint>
+
+// XXH64, unlike std::hash the value is the same on every platform and toolchain,
+// so it is safe to use as persistent key. Data can be fed in chunks of any size
+class ContentHasher {
+	std::uint64_t m_Accumulators[4];
+	std::uint8_t m_Buffer[32] = {};
+	std::size_t m_BufferSize = 0;
+	std::uint64_t m_TotalSize = 0;
+	std::uint64_t m_Seed = 0;
+public:
+	// Bump when hashing changes, persisted next to every hash
+	static constexpr std::int32_t Version = 1;
+
+	ContentHasher(std::uint64_t seed = 0);
+
+	void Update(std::string_view data);
+
+	std::uint64_t Digest()const;
+
+	static std::uint64_t Hash(std::string_view data, std::uint64_t seed = 0);
+
+	// Reads in fixed size chunks, memory use doesn't depend on file size. Nullopt if file can't be read
+	static std::optional<std::uint64_t> HashFile(const std::filesystem::path &path, std::uint64_t seed = 0);
+};
\ No newline at end of file
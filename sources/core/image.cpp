@@ -8,6 +8,15 @@
 #include "stb_image_write.h"
 #include <boost/endian/conversion.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WITH_SSE2_RGB565 1
+#include <emmintrin.h>
+#else
+#define WITH_SSE2_RGB565 0
+#endif
+
+#include "core/perf.hpp"
+
 Image::Image(std::int32_t width, std::int32_t height, std::vector<std::uint32_t>&& data):
 	m_Width(width),
 	m_Height(height),
@@ -59,25 +68,64 @@ static std::uint16_t ToRGB565(std::uint32_t rgba){
     
     return (r5 << 11) | (g6 << 5) | b5;
 }
+
+// Big endian RGB565 of count pixels, the way SHUI preview stores them
+static void ToRGB565BigEndian(const std::uint32_t *pixels, std::size_t count, std::uint16_t *out) {
+    std::size_t i = 0;
+
+#if WITH_SSE2_RGB565
+    const __m128i red_mask = _mm_set1_epi32(0xF8);
+    const __m128i green_mask = _mm_set1_epi32(0xFC00);
+    const __m128i blue_mask = _mm_set1_epi32(0x1F);
+
+    auto Convert = [&](__m128i rgba) {
+        __m128i r = _mm_slli_epi32(_mm_and_si128(rgba, red_mask), 8);
+        __m128i g = _mm_srli_epi32(_mm_and_si128(rgba, green_mask), 5);
+        __m128i b = _mm_and_si128(_mm_srli_epi32(rgba, 19), blue_mask);
+        __m128i rgb565 = _mm_or_si128(_mm_or_si128(r, g), b);
+        // Sign extended, so the signed saturating pack keeps values above 0x7FFF intact
+        return _mm_srai_epi32(_mm_slli_epi32(rgb565, 16), 16);
+    };
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i low = Convert(_mm_loadu_si128((const __m128i*)(pixels + i)));
+        __m128i high = Convert(_mm_loadu_si128((const __m128i*)(pixels + i + 4)));
+        __m128i packed = _mm_packs_epi32(low, high);
+        __m128i swapped = _mm_or_si128(_mm_slli_epi16(packed, 8), _mm_srli_epi16(packed, 8));
+        _mm_storeu_si128((__m128i*)(out + i), swapped);
+    }
+#endif
+
+    for (; i < count; i++)
+        out[i] = boost::endian::native_to_big(ToRGB565(pixels[i]));
+}
 std::string Image::ToSHUI() const{
-    static std::string ShuiPreviewLinePrefix = ";";
-    static std::string ShuiPreviewLineSuffix = "\n";
+    PROFILE_SCOPE(Image, ToSHUI);
 
-    std::string result;
-    for (int y = 0; y < Height(); y++) {
-        std::string row;
+    static constexpr char ShuiPreviewLinePrefix = ';';
+    static constexpr char ShuiPreviewLineSuffix = '\n';
+
+    const std::size_t width = m_Width;
+    const std::size_t line_size = 1 + Base64::EncodedSize(width * sizeof(std::uint16_t)) + 1;
 
-        for (int x = 0; x < Width(); x++) {
+    // Every line has the same size, so the whole preview is written into one buffer
+    std::string result(line_size * m_Height, '\0');
+    std::vector<std::uint16_t> row(width);
 
-            std::uint16_t rgb565 = ToRGB565(Get(x, y));
+    char *line = result.data();
 
-            rgb565 = boost::endian::native_to_big(rgb565);
+    for (int y = 0; y < Height(); y++) {
+        ToRGB565BigEndian(m_Data.data() + y * width, width, row.data());
 
-            row.append((const char*)&rgb565, 2);
-        }
+        line[0] = ShuiPreviewLinePrefix;
+        std::size_t encoded = Base64::Encode(row.data(), row.size() * sizeof(std::uint16_t), line + 1);
+        line[1 + encoded] = ShuiPreviewLineSuffix;
 
-        result += ShuiPreviewLinePrefix + Base64::Encode(row) + ShuiPreviewLineSuffix;
+        line += 1 + encoded + 1;
     }
+
+    result.resize(line - result.data());
+
     return result;
 }
 
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "pch/std.hpp"
+#include <list>
+
+// Keeps most recently used values up to a total size in bytes.
+// Values are shared, so eviction never invalidates one that is still in use
+template<typename KeyType, typename ValueType>
+class LruCache {
+	using Entry = std::pair<KeyType, std::shared_ptr<const ValueType>>;
+
+	// Most recently used first
+	std::list<Entry> m_Entries;
+	std::unordered_map<KeyType, typename std::list<Entry>::iterator> m_Index;
+	std::function<std::size_t(const ValueType &)> m_SizeOf;
+
+	std::size_t m_Capacity = 0;
+	std::size_t m_Size = 0;
+
+	std::int64_t m_Hits = 0;
+	std::int64_t m_Misses = 0;
+public:
+	LruCache(std::size_t capacity, std::function<std::size_t(const ValueType &)> size_of):
+		m_SizeOf(std::move(size_of)),
+		m_Capacity(capacity)
+	{}
+
+	std::shared_ptr<const ValueType> Find(const KeyType &key) {
+		auto it = m_Index.find(key);
+
+		if (it == m_Index.end()) {
+			m_Misses++;
+			return nullptr;
+		}
+
+		m_Hits++;
+		m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+
+		return it->second->second;
+	}
+
+	void Put(const KeyType &key, std::shared_ptr<const ValueType> value) {
+		Remove(key);
+
+		std::size_t size = m_SizeOf(*value);
+
+		if(size > m_Capacity)
+			return;
+
+		m_Entries.emplace_front(key, std::move(value));
+		m_Index.emplace(key, m_Entries.begin());
+		m_Size += size;
+
+		while (m_Size > m_Capacity)
+			Remove(m_Entries.back().first);
+	}
+
+	void Remove(const KeyType &key) {
+		auto it = m_Index.find(key);
+
+		if(it == m_Index.end())
+			return;
+
+		m_Size -= m_SizeOf(*it->second->second);
+		m_Entries.erase(it->second);
+		m_Index.erase(it);
+	}
+
+	std::size_t Size()const{ return m_Size; }
+
+	std::size_t Capacity()const{ return m_Capacity; }
+
+	std::int64_t Hits()const{ return m_Hits; }
+
+	std::int64_t Misses()const{ return m_Misses; }
+};
@@ -35,6 +35,8 @@ private:
 
 #if WITH_PROFILE
 #define PROFILE_SCOPE(category, name) ScopedTimer __timer##category##name##__LINE__(#category, #name)
+#define PROFILE_VALUE(category, name, value) LogPerf(Verbose, "[%] % is %", #category, #name, value)
 #else
 #define PROFILE_SCOPE(category, name) ((void)0)
+#define PROFILE_VALUE(category, name, value) ((void)0)
 #endif
@@ -0,0 +1,186 @@
+#include "persistence.hpp"
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <bsl/log.hpp>
+
+DEFINE_LOG_CATEGORY(Persistence)
+
+using Clock = std::chrono::steady_clock;
+
+static PersistenceSyncPolicy s_SyncPolicy = PersistenceSyncPolicy::File;
+
+static bool SyncFile(std::FILE *file) {
+#ifdef _WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+static void SyncDirectory(const std::filesystem::path &directory) {
+#ifndef _WIN32
+	int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+
+	if(fd < 0)
+		return;
+
+	fsync(fd);
+	close(fd);
+#endif
+}
+
+struct PendingWrite {
+	std::string Content;
+	Clock::time_point QueuedAt;
+};
+
+class PersistenceWriter {
+	std::mutex m_Lock;
+	std::condition_variable m_Changed;
+
+	// Paths in order they were first queued, content is taken at write time so repeated writes coalesce
+	std::deque<std::string> m_Order;
+	std::unordered_map<std::string, PendingWrite> m_Pending;
+	bool m_Writing = false;
+	bool m_Stopping = false;
+
+	std::thread m_Thread;
+public:
+	PersistenceWriter() {
+		m_Thread = std::thread(&PersistenceWriter::Run, this);
+	}
+
+	~PersistenceWriter() {
+		{
+			std::lock_guard<std::mutex> lock(m_Lock);
+			m_Stopping = true;
+		}
+		m_Changed.notify_all();
+		m_Thread.join();
+	}
+
+	void Write(const std::filesystem::path &path, std::string content) {
+		std::size_t depth = 0;
+
+		{
+			std::lock_guard<std::mutex> lock(m_Lock);
+
+			auto [it, inserted] = m_Pending.try_emplace(path.string());
+
+			if (inserted) {
+				it->second.QueuedAt = Clock::now();
+				m_Order.push_back(it->first);
+			}
+
+			it->second.Content = std::move(content);
+			depth = m_Order.size();
+		}
+
+		m_Changed.notify_all();
+
+		LogPersistence(Verbose, "% writes queued", depth);
+	}
+
+	void Flush() {
+		std::unique_lock<std::mutex> lock(m_Lock);
+		m_Changed.wait(lock, [this]() { return !m_Order.size() && !m_Writing; });
+	}
+private:
+	void Run() {
+		std::unique_lock<std::mutex> lock(m_Lock);
+
+		for (;;) {
+			m_Changed.wait(lock, [this]() { return m_Order.size() || m_Stopping; });
+
+			// Drained on stop, nothing queued is lost on normal exit
+			if(!m_Order.size())
+				return;
+
+			std::string path = std::move(m_Order.front());
+			m_Order.pop_front();
+
+			auto pending = m_Pending.extract(path);
+			m_Writing = true;
+
+			lock.unlock();
+
+			Persistence::WriteNow(path, pending.mapped().Content);
+
+			auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - pending.mapped().QueuedAt).count();
+			LogPersistence(Verbose, "Wrote % after % ms in queue", path, latency);
+
+			lock.lock();
+
+			m_Writing = false;
+			m_Changed.notify_all();
+		}
+	}
+};
+
+static PersistenceWriter &Writer() {
+	static PersistenceWriter s_Writer;
+
+	return s_Writer;
+}
+
+void Persistence::SetSyncPolicy(PersistenceSyncPolicy policy) {
+	s_SyncPolicy = policy;
+}
+
+void Persistence::Write(const std::filesystem::path& path, std::string content) {
+	Writer().Write(path, std::move(content));
+}
+
+bool Persistence::WriteNow(const std::filesystem::path& path, const std::string& content) {
+	PersistenceSyncPolicy policy = s_SyncPolicy;
+
+	auto temp_path = path;
+	temp_path += ".tmp";
+
+	std::FILE *file = std::fopen(temp_path.string().c_str(), "wb");
+
+	if (!file) {
+		LogPersistence(Error, "Can't open '%'", temp_path.string());
+		return false;
+	}
+
+	bool written = std::fwrite(content.data(), 1, content.size(), file) == content.size() && std::fflush(file) == 0;
+
+	if(written && policy != PersistenceSyncPolicy::None)
+		written = SyncFile(file);
+
+	std::fclose(file);
+
+	std::error_code ec;
+
+	if (!written) {
+		LogPersistence(Error, "Can't write '%'", temp_path.string());
+		std::filesystem::remove(temp_path, ec);
+		return false;
+	}
+
+	std::filesystem::rename(temp_path, path, ec);
+
+	if (ec) {
+		LogPersistence(Error, "Can't replace '%': %", path.string(), ec.message());
+		return false;
+	}
+
+	if(policy == PersistenceSyncPolicy::FileAndDirectory)
+		SyncDirectory(path.parent_path());
+
+	return true;
+}
+
+void Persistence::Flush() {
+	Writer().Flush();
+}
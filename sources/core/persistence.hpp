@@ -0,0 +1,28 @@
+#pragma once
+
+#include "pch/std.hpp"
+#include <bsl/enum.hpp>
+
+BSL_ENUM(PersistenceSyncPolicy,
+	// Rename only, data reaches the disk whenever OS decides
+	None,
+	// File is synced before rename, content survives power loss
+	File,
+	// Directory is synced after rename too, so does the rename itself
+	FileAndDirectory
+);
+
+// Writes go through a temp file and rename, a crash leaves either old or new content, never a partial one
+namespace Persistence{
+// Expected to be set once on startup, before anything is written
+extern void SetSyncPolicy(PersistenceSyncPolicy policy);
+
+// Queues write for the background writer, a later write to a still queued path replaces its content
+extern void Write(const std::filesystem::path &path, std::string content);
+
+// Writes on the calling thread, must not be mixed with queued writes to the same path
+extern bool WriteNow(const std::filesystem::path &path, const std::string &content);
+
+// Blocks until everything queued so far is written
+extern void Flush();
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "pch/std.hpp"
+#include <charconv>
 
 class StringStream {
     const std::string &m_Input;
@@ -55,3 +56,92 @@ inline std::string_view SubstrAfter(std::string_view string, std::string_view pr
 
     return string.substr(rn1 + prefix.size());
 }
+
+inline std::string_view Trim(std::string_view string) {
+    while(string.size() && std::isspace((unsigned char)string.back()))
+        string.remove_suffix(1);
+
+    while(string.size() && std::isspace((unsigned char)string.front()))
+        string.remove_prefix(1);
+
+    return string;
+}
+
+// Whole string has to be a number
+inline std::optional<double> ParseDouble(std::string_view string) {
+    double value = 0;
+    auto [end, ec] = std::from_chars(string.data(), string.data() + string.size(), value);
+
+    if(ec != std::errc() || end != string.data() + string.size())
+        return std::nullopt;
+
+    return value;
+}
+
+// Fixed notation without trailing zeros, the way G-code numbers are written
+inline void AppendFixed(std::string &out, double value, int precision) {
+    char buffer[64];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, precision);
+
+    std::string_view number(buffer, end - buffer);
+
+    if (number.find('.') != std::string_view::npos) {
+        while(number.ends_with('0'))
+            number.remove_suffix(1);
+
+        if(number.ends_with('.'))
+            number.remove_suffix(1);
+    }
+
+    if(number == "-0")
+        number = "0";
+
+    out.append(number);
+}
+
+// Percent-encodes everything except unreserved characters, for a single path segment
+inline std::string UrlEncode(std::string_view string) {
+    static constexpr char Hex[] = "0123456789ABCDEF";
+
+    std::string result;
+    result.reserve(string.size());
+
+    for (char ch : string) {
+        unsigned char byte = ch;
+
+        if (std::isalnum(byte) || ch == '-' || ch == '_' || ch == '.' || ch == '~') {
+            result += ch;
+            continue;
+        }
+
+        result += '%';
+        result += Hex[byte >> 4];
+        result += Hex[byte & 0xF];
+    }
+
+    return result;
+}
+
+// Malformed escapes are kept as is
+inline std::string UrlDecode(std::string_view string) {
+    std::string result;
+    result.reserve(string.size());
+
+    for (std::size_t i = 0; i < string.size(); i++) {
+        unsigned int code = 0;
+
+        if (string[i] == '%' && i + 2 < string.size()) {
+            auto [end, ec] = std::from_chars(string.data() + i + 1, string.data() + i + 3, code, 16);
+
+            if (ec == std::errc() && end == string.data() + i + 3) {
+                result += char(code);
+                i += 2;
+                continue;
+            }
+        }
+
+        result += string[i];
+    }
+
+    return result;
+}
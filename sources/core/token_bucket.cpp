@@ -0,0 +1,68 @@
+#include "token_bucket.hpp"
+
+TokenBucket::TokenBucket(std::size_t rate, std::size_t burst):
+	m_Rate(rate),
+	m_Burst(std::max(burst, std::size_t(1))),
+	// Start full, so the first chunk of an upload goes out immediately
+	m_Tokens(m_Burst),
+	m_LastRefill(Clock::now())
+{}
+
+void TokenBucket::SetLimit(std::size_t rate, std::size_t burst) {
+	std::unique_lock lock(m_Lock);
+
+	auto now = Clock::now();
+	// Tokens gathered so far are kept, so changing rate mid upload doesn't grant a free burst
+	double tokens = m_Rate > 0 ? TokensAt(now) : std::max(burst, std::size_t(1));
+
+	m_Rate = rate;
+	m_Burst = std::max(burst, std::size_t(1));
+	m_Tokens = std::min(tokens, m_Burst);
+	m_LastRefill = now;
+}
+
+std::size_t TokenBucket::Rate()const {
+	std::unique_lock lock(m_Lock);
+	return m_Rate;
+}
+
+std::size_t TokenBucket::Burst()const {
+	std::unique_lock lock(m_Lock);
+
+	if(m_Rate <= 0)
+		return std::numeric_limits<std::size_t>::max();
+
+	return m_Burst;
+}
+
+TokenBucket::Clock::duration TokenBucket::Delay(std::size_t bytes)const {
+	std::unique_lock lock(m_Lock);
+
+	if(m_Rate <= 0)
+		return Clock::duration::zero();
+
+	double missing = std::min<double>(bytes, m_Burst) - TokensAt(Clock::now());
+
+	if(missing <= 0)
+		return Clock::duration::zero();
+
+	return std::chrono::ceil<Clock::duration>(std::chrono::duration<double>(missing / m_Rate));
+}
+
+void TokenBucket::Consume(std::size_t bytes) {
+	std::unique_lock lock(m_Lock);
+
+	if(m_Rate <= 0)
+		return;
+
+	auto now = Clock::now();
+	// May go below zero when consumed without waiting, the debt is paid off by later delays
+	m_Tokens = TokensAt(now) - bytes;
+	m_LastRefill = now;
+}
+
+double TokenBucket::TokensAt(Clock::time_point now)const {
+	double elapsed = std::chrono::duration<double>(now - m_LastRefill).count();
+
+	return std::min(m_Burst, m_Tokens + elapsed * m_Rate);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "pch/std.hpp"
+#include <mutex>
+
+// Tokens are bytes, refilled continuously at Rate up to Burst, zero rate means unlimited
+class TokenBucket {
+public:
+	using Clock = std::chrono::steady_clock;
+private:
+	mutable std::mutex m_Lock;
+	double m_Rate = 0;
+	double m_Burst = 0;
+	double m_Tokens = 0;
+	Clock::time_point m_LastRefill;
+public:
+	TokenBucket(std::size_t rate = 0, std::size_t burst = 0);
+
+	void SetLimit(std::size_t rate, std::size_t burst);
+
+	std::size_t Rate()const;
+
+	// Biggest amount that can ever be consumed at once
+	std::size_t Burst()const;
+
+	// How long until bytes can be consumed, zero when they already can
+	Clock::duration Delay(std::size_t bytes)const;
+
+	void Consume(std::size_t bytes);
+private:
+	double TokensAt(Clock::time_point now)const;
+};
@@ -0,0 +1,168 @@
+#include "multipart.hpp"
+#include "core/string_utils.hpp"
+
+// Part headers are a couple of short lines, anything longer is not a form
+static constexpr std::size_t MaxHeadersSize = 16 * 1024;
+
+MultipartParser::MultipartParser(std::string_view boundary):
+    m_Delimiter("\r\n--" + std::string(boundary))
+{}
+
+bool MultipartParser::Feed(std::string_view chunk) {
+    if(m_State == State::Failed)
+        return false;
+
+    if(m_State == State::Epilogue)
+        return true;
+
+    m_Pending.append(chunk);
+
+    std::string_view pending = m_Pending;
+
+    for (bool progress = true; progress && m_State != State::Failed && m_State != State::Epilogue;) {
+        switch (m_State) {
+        case State::Preamble: {
+            std::string_view delimiter = std::string_view(m_Delimiter).substr(2);
+            auto position = pending.find(delimiter);
+
+            if (position == std::string_view::npos) {
+                // Preamble is dropped, only what may be the start of the boundary is kept
+                pending.remove_prefix(pending.size() - std::min(pending.size(), delimiter.size() - 1));
+                progress = false;
+                break;
+            }
+
+            pending.remove_prefix(position + delimiter.size());
+            m_State = State::Boundary;
+            break;
+        }
+        case State::Boundary: {
+            if (pending.size() < 2) {
+                progress = false;
+                break;
+            }
+
+            if (pending.starts_with("--")) {
+                m_State = State::Epilogue;
+            } else if (pending.starts_with("\r\n")) {
+                m_State = State::Headers;
+            } else {
+                m_State = State::Failed;
+            }
+
+            pending.remove_prefix(2);
+            break;
+        }
+        case State::Headers: {
+            auto end = pending.find("\r\n\r\n");
+
+            if (end == std::string_view::npos) {
+                if(pending.size() > MaxHeadersSize)
+                    m_State = State::Failed;
+                progress = false;
+                break;
+            }
+
+            std::call(OnPartBegin, ParseHeaders(pending.substr(0, end)));
+
+            pending.remove_prefix(end + 4);
+            m_State = State::Data;
+            break;
+        }
+        case State::Data: {
+            auto end = pending.find(m_Delimiter);
+
+            if (end == std::string_view::npos) {
+                // Tail may be the beginning of the delimiter split between chunks
+                std::size_t safe = pending.size() - std::min(pending.size(), m_Delimiter.size() - 1);
+
+                if(safe)
+                    std::call(OnPartData, pending.substr(0, safe));
+
+                pending.remove_prefix(safe);
+                progress = false;
+                break;
+            }
+
+            if(end)
+                std::call(OnPartData, pending.substr(0, end));
+
+            std::call(OnPartEnd);
+
+            pending.remove_prefix(end + m_Delimiter.size());
+            m_State = State::Boundary;
+            break;
+        }
+        default:
+            progress = false;
+            break;
+        }
+    }
+
+    if(m_State == State::Epilogue)
+        pending = {};
+
+    m_Pending.erase(0, m_Pending.size() - pending.size());
+
+    return m_State != State::Failed;
+}
+
+bool MultipartParser::IsDone()const {
+    return m_State == State::Epilogue;
+}
+
+std::string_view MultipartParser::ExtractBoundary(std::string_view content_type) {
+    size_t boundary_position = content_type.find("boundary=");
+    if (boundary_position == std::string_view::npos) {
+        return {};
+    }
+    
+    std::string_view boundary = content_type.substr(boundary_position + 9);
+    boundary = boundary.substr(0, boundary.find(';'));
+    if (!boundary.empty() && boundary.front() == '"') {
+        boundary.remove_prefix(1);
+    }
+    if (!boundary.empty() && boundary.back() == '"') {
+        boundary.remove_suffix(1);
+    }
+    return boundary;
+}
+
+MultipartParser::Headers MultipartParser::ParseHeaders(std::string_view headers) {
+    static constexpr std::string_view DispositionPrefix = "Content-Disposition: form-data;";
+
+    Headers result;
+
+    std::string_view line = SubstrAfter(headers, DispositionPrefix);
+    line = line.substr(0, line.find("\r\n"));
+
+    while (line.size()) {
+        // Filenames are quoted and may contain separators themselves
+        std::size_t separator = 0;
+        for (bool quoted = false; separator < line.size() && (quoted || line[separator] != ';'); separator++) {
+            if(line[separator] == '"')
+                quoted = !quoted;
+        }
+        separator = separator < line.size() ? separator : std::string_view::npos;
+
+        std::string_view parameter = Trim(line.substr(0, separator));
+        line = separator == std::string_view::npos ? std::string_view() : line.substr(separator + 1);
+
+        auto equals = parameter.find('=');
+
+        if(equals == std::string_view::npos)
+            continue;
+
+        std::string_view name = Trim(parameter.substr(0, equals));
+        std::string_view value = Trim(parameter.substr(equals + 1));
+
+        if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+            value.remove_prefix(1);
+            value.remove_suffix(1);
+        }
+
+        result.emplace(name, value);
+    }
+
+    return result;
+}
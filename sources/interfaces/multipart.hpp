@@ -0,0 +1,42 @@
+#pragma once
+
+#include "pch/std.hpp"
+#include <map>
+
+// Incremental multipart/form-data parser, body can be fed in chunks of any size as it arrives.
+// Only headers of the current part and a boundary sized tail of its data are kept in memory
+class MultipartParser {
+public:
+    // Content-Disposition parameters, like name and filename
+    using Headers = std::map<std::string, std::string>;
+
+    std::function<void(const Headers &)> OnPartBegin;
+    std::function<void(std::string_view)> OnPartData;
+    std::function<void()> OnPartEnd;
+private:
+    enum class State {
+        Preamble,
+        Boundary,
+        Headers,
+        Data,
+        Epilogue,
+        Failed
+    };
+
+    // CRLF, dashes and boundary, first one may come without the CRLF
+    std::string m_Delimiter;
+    std::string m_Pending;
+    State m_State = State::Preamble;
+public:
+    MultipartParser(std::string_view boundary);
+
+    // False once the body turned out to be malformed
+    bool Feed(std::string_view chunk);
+
+    // Closing boundary was seen
+    bool IsDone()const;
+
+    static std::string_view ExtractBoundary(std::string_view content_type);
+
+    static Headers ParseHeaders(std::string_view headers);
+};
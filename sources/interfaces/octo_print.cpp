@@ -1,168 +1,590 @@
 #include "octo_print.hpp"
-#include <bsl/log.hpp>
-#include "pch/asio.hpp"
 #include "core/string_utils.hpp"
+#include <bsl/log.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/beast/core/bind_handler.hpp>
 
-OctoPrintInterface::OctoPrintInterface(std::shared_ptr<Printer> printer, std::uint16_t port):
-	m_Printer(printer)
-{
-	m_Server.add_route("/api/version")
-		.get(std::bind(&OctoPrintInterface::GetVersion, this, std::placeholders::_1, std::placeholders::_2));
-	m_Server.add_route("/api/files/local")
-		.post(std::bind(&OctoPrintInterface::PostFilesLocal, this, std::placeholders::_1, std::placeholders::_2));
+DEFINE_LOG_CATEGORY(OctoPrint)
+
+namespace http = boost::beast::http;
+
+static constexpr std::size_t BodyChunkSize = 64 * 1024;
+static constexpr std::uint64_t MaxUploadSize = 2ull * 1024 * 1024 * 1024;
+// Print flag is "true" or "false", anything longer is cut
+static constexpr std::size_t MaxFieldSize = 64;
+static constexpr auto ReadTimeout = std::chrono::seconds(30);
+static constexpr std::string_view FilesLocalPrefix = "/api/files/local/";
+// Polling faster than this gets the same snapshot
+static constexpr auto SnapshotMaxAge = std::chrono::milliseconds(500);
+static constexpr std::size_t MaxTrackedUploads = 32;
+
+static std::string FileLocation(std::string_view host, const std::string &filename) {
+    std::string path = std::string(FilesLocalPrefix) + UrlEncode(filename);
 
-    m_Server.listen(port);
+    return host.size() ? "http://" + std::string(host) + path : path;
 }
 
-void OctoPrintInterface::RunAsync() {
-	//Idk
+OctoPrintSession::OctoPrintSession(OctoPrintInterface &owner, boost::asio::ip::tcp::socket &&socket):
+    m_Owner(owner),
+    m_Stream(std::move(socket)),
+    m_Chunk(BodyChunkSize)
+{}
+
+OctoPrintSession::~OctoPrintSession() {
+    // Connection dropped in the middle of the upload
+    DiscardSpool();
 }
 
-void OctoPrintInterface::GetVersion(const beauty::request& req, beauty::response& resp) {
-	resp.body() = R"({
-		"api": "0.1",
-		"server": "1.3.10",
-		"text": "OctoPrint 1.3.10"
-	})";
-	resp.set(beauty::content_type::application_json);
+void OctoPrintSession::Run() {
+    ReadHeader();
+}
+
+void OctoPrintSession::ReadHeader() {
+    m_Request.emplace();
+    m_Request->body_limit(MaxUploadSize);
+    m_Multipart.reset();
+
+    m_Stream.expires_after(ReadTimeout);
+    http::async_read_header(m_Stream, m_Buffer, *m_Request, boost::beast::bind_front_handler(&OctoPrintSession::OnHeader, shared_from_this()));
 }
 
-struct MultipartPart {
-    std::map<std::string, std::string> headers;
-    std::string_view content;
-};
+void OctoPrintSession::OnHeader(boost::beast::error_code ec, std::size_t bytes_transferred) {
+    if(ec)
+        return;
+
+    const auto &request = m_Request->get();
+    std::string_view target = request.target();
+    target = target.substr(0, target.find('?'));
 
-static std::string_view ExtractBoundary(std::string_view contentType) {
-    size_t boundaryPos = contentType.find("boundary=");
-    if (boundaryPos == std::string_view::npos) {
-        return {};
+    if (request.method() == http::verb::get && target == "/api/version") {
+        Respond(http::status::ok, m_Owner.GetVersion());
+        return;
     }
-    
-    std::string_view boundary = contentType.substr(boundaryPos + 9);
-    if (!boundary.empty() && boundary.front() == '"') {
-        boundary.remove_prefix(1);
+
+    if (request.method() == http::verb::get && target == "/api/job") {
+        Respond(http::status::ok, m_Owner.GetJob());
+        return;
     }
-    if (!boundary.empty() && boundary.back() == '"') {
-        boundary.remove_suffix(1);
+
+    if (request.method() == http::verb::get && target.starts_with(FilesLocalPrefix)) {
+        std::string filename = UrlDecode(target.substr(FilesLocalPrefix.size()));
+
+        if (std::optional<std::string> file = m_Owner.GetFileLocal(filename, FileLocation(request[http::field::host], filename))) {
+            Respond(http::status::ok, std::move(file.value()));
+            return;
+        }
+
+        Respond(http::status::not_found, R"({"error": "File not found"})");
+        return;
     }
-    return boundary;
-}
 
-static bool ParseMultipartFrame(std::string_view body, std::size_t start, std::string_view boundary, std::string_view &part, std::size_t &part_end) {
-    auto boundary1 = body.find(boundary, start);
+    if (request.method() == http::verb::post && target == "/api/files/local") {
+        if(!BeginFilesLocal())
+            return;
+
+        // Clients holding the body back until told to go on would otherwise wait for their own timeout
+        if (request[http::field::expect] == "100-continue") {
+            m_Continue = {http::status::continue_, request.version()};
+            http::async_write(m_Stream, m_Continue, boost::beast::bind_front_handler(&OctoPrintSession::OnContinueWritten, shared_from_this()));
+            return;
+        }
+
+        ReadBodyChunk();
+        return;
+    }
 
-    if(boundary1 == std::string_view::npos)
+    // Body of an unknown request is never read, so the connection can't be reused
+    Respond(http::status::not_found, R"({"error": "Not found"})", false);
+}
+
+bool OctoPrintSession::BeginFilesLocal() {
+#if !WITH_PRINTER_DEBUG
+    if (!m_Owner.CanUpload()) {
+        Respond(http::status::service_unavailable, R"({"error": "Printer is not connected"})", false);
         return false;
+    }
+#endif
 
-    auto boundary2 = body.find(boundary, boundary1 + boundary.size());
+    std::string_view boundary = MultipartParser::ExtractBoundary(m_Request->get()[http::field::content_type]);
 
-    if(boundary2 == std::string_view::npos)
+    if (boundary.empty()) {
+        Respond(http::status::bad_request, R"({"error": "Invalid multipart boundary"})", false);
         return false;
-    
-    part = body.substr(boundary1 + boundary.size(), boundary2 - boundary1 - boundary.size());
-    part_end = boundary2;
+    }
+
+    m_Multipart.emplace(boundary);
+    m_PartName.clear();
+    m_Filename.clear();
+    m_Print.clear();
+    m_PrintSeen = false;
+    m_UploadId = 0;
+
+    m_Multipart->OnPartBegin = [this](const MultipartParser::Headers &headers) {
+        auto name = headers.find("name");
+        m_PartName = name != headers.end() ? name->second : std::string();
+
+        // Only the first file is taken
+        if (m_PartName != "file" || !m_SpoolPath.empty()) {
+            m_PartName = m_PartName == "file" ? std::string() : m_PartName;
+            return;
+        }
+
+        auto filename = headers.find("filename");
+        m_Filename = filename != headers.end() ? filename->second : std::string();
+
+        m_SpoolPath = m_Owner.MakeSpoolPath();
+        m_Spool.open(m_SpoolPath, std::ios::binary | std::ios::trunc);
+        m_SpoolSize = 0;
+
+        LogOctoPrintIf(!m_Spool.is_open(), Error, "Can't open spool file %", m_SpoolPath.string());
+
+        // Whole body is the only size known up front. Print flag can't change once the upload is started,
+        // so a body sending it after the file, or not at all, goes the spooled way and the flag is read at the end
+        auto size_bound = m_Request->content_length();
+
+        if (m_Spool.is_open() && size_bound && m_PrintSeen) {
+            auto stream = std::make_shared<GCodeUploadStream>(m_SpoolPath, *size_bound);
+
+            if (std::optional<std::uint64_t> id = m_Owner.BeginStreamedUpload(m_Filename, stream, m_Print == "true")) {
+                m_UploadStream = std::move(stream);
+                m_UploadId = *id;
+            }
+        }
+    };
+
+    m_Multipart->OnPartData = [this](std::string_view data) {
+        if (m_PartName == "file") {
+            m_Spool.write(data.data(), data.size());
+            m_SpoolSize += data.size();
+        }
+
+        if(m_PartName == "print")
+            m_Print.append(data.substr(0, MaxFieldSize - std::min(MaxFieldSize, m_Print.size())));
+    };
+
+    m_Multipart->OnPartEnd = [this]() {
+        if(m_PartName == "print")
+            m_PrintSeen = true;
+
+        if(m_PartName == "file")
+            m_Spool.close();
+
+        if (m_PartName == "file" && m_UploadStream) {
+            m_UploadStream->Grow(m_SpoolSize);
+            m_UploadStream->Finish(!m_Spool.fail());
+
+            // Storage owns the complete spool from now on
+            if(!m_Spool.fail())
+                m_SpoolPath.clear();
+        }
+
+        m_PartName.clear();
+    };
+
     return true;
 }
 
-static std::string_view ParseMultipartContent(std::string_view frame) {
-    static constexpr std::string_view ContentPrefix = "\r\n\r\n";
-    static constexpr std::string_view ContentSuffix = "\r\n";
-    return SubstrBy(frame, ContentPrefix, ContentSuffix);
+void OctoPrintSession::OnContinueWritten(boost::beast::error_code ec, std::size_t bytes_transferred) {
+    if(ec)
+        return;
+
+    ReadBodyChunk();
 }
 
-std::map<std::string, std::string> ParseMultipartHeaders(std::string_view frame) {
-    static constexpr std::string_view HeadersPrefix = "Content-Disposition: form-data;";
-    static constexpr std::string_view HeadersSuffix = "\n";
-    
-    auto line = SubstrBy(frame, HeadersPrefix, HeadersSuffix);
+void OctoPrintSession::ReadBodyChunk() {
+    auto &body = m_Request->get().body();
+    body.data = m_Chunk.data();
+    body.size = m_Chunk.size();
 
-    if(!line.size())
-        return {};
+    m_Stream.expires_after(ReadTimeout);
+    http::async_read_some(m_Stream, m_Buffer, *m_Request, boost::beast::bind_front_handler(&OctoPrintSession::OnBodyChunk, shared_from_this()));
+}
+
+void OctoPrintSession::OnBodyChunk(boost::beast::error_code ec, std::size_t bytes_transferred) {
+    // Chunk is full, not an error
+    if(ec == http::error::need_buffer)
+        ec = {};
 
-    std::map<std::string, std::string> result;
+    if (ec) {
+        LogOctoPrint(Warning, "Upload of '%' was interrupted: %", m_Filename, ec.message());
+        return;
+    }
 
-    for (;;) {
-        std::string_view name = SubstrBy(line, " ", "=");
-        std::string_view value = SubstrBy(line, "\"", "\"");
+    std::size_t received = m_Chunk.size() - m_Request->get().body().size;
 
-        if (!name.size() || !value.size())
-            break;
+    if (received && !m_Multipart->Feed(std::string_view(m_Chunk.data(), received))) {
+        DiscardSpool();
+        Respond(http::status::bad_request, R"({"error": "Malformed multipart body"})", false);
+        return;
+    }
 
-        line = line.substr(name.size() + value.size() + 4);
+    if (m_UploadStream && !m_UploadStream->IsFinished()) {
+        // Forwarding reads the spool file, what is still in the stream buffer doesn't exist for it
+        m_Spool.flush();
+        m_UploadStream->Grow(m_SpoolSize);
+    }
 
-        result.emplace(name, value);
+    if (!m_Request->is_done()) {
+        ReadBodyChunk();
+        return;
     }
 
-    return result;
+    OnFilesLocalReceived();
 }
 
-static std::vector<MultipartPart> ParseMultipartData(std::string_view body, std::string_view boundaryParam) {
-    std::vector<MultipartPart> parts;
-    
-    std::string delimiter = std::string("--") + std::string(boundaryParam);
-    
-    
-    std::size_t pos = 0;
-    std::size_t end_pos = 0;
-    std::string_view part;
+void OctoPrintSession::OnFilesLocalReceived() {
+    if(m_Spool.is_open())
+        m_Spool.close();
 
-    while(ParseMultipartFrame(body, pos, delimiter, part, end_pos)) {
-        pos = end_pos;
+    if (m_UploadStream) {
+        bool received = m_UploadStream->IsFinished() && !m_UploadStream->IsFailed() && m_Multipart->IsDone();
 
+        DiscardSpool();
+        m_UploadStream.reset();
 
-        MultipartPart multipart;
-        multipart.content = ParseMultipartContent(part);
-        multipart.headers = ParseMultipartHeaders(part);
-        parts.push_back(multipart);
+        if(received)
+            RespondCreated();
+        else
+            Respond(http::status::bad_request, R"({"error": "No file received"})");
+        return;
     }
-    
-        
-    return parts;
-}
 
-void OctoPrintInterface::PostFilesLocal(const beauty::request& req, beauty::response& resp) {
-#if !WITH_PRINTER_DEBUG
-    if(!m_Printer || !m_Printer->IsConnected()) {
-        throw beauty::http_error::server::service_unavailable();
+    if (m_SpoolPath.empty() || !m_Multipart->IsDone() || m_Spool.fail()) {
+        DiscardSpool();
+        Respond(http::status::bad_request, R"({"error": "No file received"})");
+        return;
     }
-#endif
 
-    std::string_view contentType = req.base().at("Content-Type");
-    std::string_view boundary = ExtractBoundary(contentType);
-    
-    if (boundary.empty()) {
-        throw beauty::http_error::client::bad_request("Invalid multipart boundary");
-    }
-    
-    std::vector<MultipartPart> parts = ParseMultipartData(req.body(), boundary);
-
-    std::string_view print;
-    std::string_view file_content;
-    std::string filename;
-    
-    for (const auto& part : parts) {
-        auto nameIt = part.headers.find("name");
-
-        if (nameIt == part.headers.end()) {
-            continue;
-        }
-        
-        if (nameIt->second == "print") {
-            print = part.content;
-        } 
-        if (nameIt->second == "file") {
-            file_content = part.content;
-            auto filenameIt = part.headers.find("filename");
-            if (filenameIt != part.headers.end()) {
-                filename = filenameIt->second;
-            }
-        }
+    std::filesystem::path spool = std::exchange(m_SpoolPath, {});
+
+    m_UploadId = m_Owner.PostFilesLocal(m_Filename, spool, m_Print == "true");
+
+    RespondCreated();
+}
+
+void OctoPrintSession::RespondCreated() {
+    // Slicers follow Location to poll the upload, like with OctoPrint itself
+    std::string location = FileLocation(m_Request->get()[http::field::host], m_Filename);
+
+    PrepareResponse(http::status::created, m_Owner.MakeUploadCreated(m_UploadId, location), true);
+    m_Response.set(http::field::location, location);
+
+    WriteResponse();
+}
+
+void OctoPrintSession::Respond(http::status status, std::string body, bool keep_alive) {
+    PrepareResponse(status, std::move(body), keep_alive);
+
+    WriteResponse();
+}
+
+void OctoPrintSession::PrepareResponse(http::status status, std::string body, bool keep_alive) {
+    const auto &request = m_Request->get();
+
+    m_Response = Response(status, request.version());
+    m_Response.set(http::field::content_type, "application/json");
+    m_Response.keep_alive(keep_alive && request.keep_alive());
+    m_Response.body() = std::move(body);
+    m_Response.prepare_payload();
+}
+
+void OctoPrintSession::WriteResponse() {
+    http::async_write(m_Stream, m_Response, boost::beast::bind_front_handler(&OctoPrintSession::OnWrite, shared_from_this()));
+}
+
+void OctoPrintSession::OnWrite(boost::beast::error_code ec, std::size_t bytes_transferred) {
+    if(ec)
+        return;
+
+    if (!m_Response.keep_alive()) {
+        m_Stream.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+        return;
     }
-    
-    bool should_print = (print == "true");
-
-    m_Printer->Storage().UploadGCodeFileAsync(filename, std::string(file_content), should_print, nullptr);
-    
-    resp.body() = R"({"done": true})";
-    resp.set(beauty::content_type::application_json);
-}
\ No newline at end of file
+
+    ReadHeader();
+}
+
+void OctoPrintSession::DiscardSpool() {
+    // Forwarding fails before its spool is gone, does nothing once the file part is complete
+    if(m_UploadStream)
+        m_UploadStream->Finish(false);
+
+    if(m_SpoolPath.empty())
+        return;
+
+    if(m_Spool.is_open())
+        m_Spool.close();
+
+    std::error_code ec;
+    std::filesystem::remove(std::exchange(m_SpoolPath, {}), ec);
+}
+
+OctoPrintInterface::OctoPrintInterface(std::shared_ptr<Printer> printer, std::uint16_t port, const std::filesystem::path &spool_path):
+	m_Printer(printer),
+	m_SpoolPath(spool_path)
+{
+	std::error_code fs_ec;
+	// Leftovers of uploads interrupted by a restart
+	std::filesystem::remove_all(m_SpoolPath, fs_ec);
+	std::filesystem::create_directories(m_SpoolPath, fs_ec);
+
+	boost::beast::error_code ec;
+	boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::tcp::v4(), port);
+
+	m_Acceptor.open(endpoint.protocol(), ec);
+	m_Acceptor.set_option(boost::asio::socket_base::reuse_address(true), ec);
+	m_Acceptor.bind(endpoint, ec);
+	m_Acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
+
+	if (ec) {
+		LogOctoPrint(Error, "Can't listen on port %: %", port, ec.message());
+		return;
+	}
+
+	Accept();
+}
+
+void OctoPrintInterface::RunAsync() {
+	//Idk
+}
+
+std::string OctoPrintInterface::GetVersion()const {
+	return R"({
+		"api": "0.1",
+		"server": "1.3.10",
+		"text": "OctoPrint 1.3.10"
+	})";
+}
+
+bool OctoPrintInterface::CanUpload()const {
+	return m_Printer && m_Printer->IsConnected();
+}
+
+std::filesystem::path OctoPrintInterface::MakeSpoolPath() {
+	return m_SpoolPath / (std::to_string(++m_LastSpoolId) + ".gcode");
+}
+
+std::uint64_t OctoPrintInterface::PostFilesLocal(const std::string &filename, const std::filesystem::path &spool, bool print) {
+	std::uint64_t id = TrackUpload(filename);
+
+	auto OnQueued = [this, id](std::uint64_t storage_id) {
+		OnUploadQueued(id, storage_id);
+	};
+
+	auto OnUploaded = [this, id](std::exception_ptr error, bool success) {
+		OnUploadFinished(id, !error && success);
+	};
+
+	boost::asio::co_spawn(Async::Context(), m_Printer->Storage().UploadSpooled(filename, spool, print, OnQueued), OnUploaded);
+
+	return id;
+}
+
+std::optional<std::uint64_t> OctoPrintInterface::BeginStreamedUpload(const std::string &filename, std::shared_ptr<GCodeUploadStream> stream, bool print) {
+	std::uint64_t id = TrackUpload(filename);
+
+	auto OnUploaded = [this, id](bool success) {
+		OnUploadFinished(id, success);
+	};
+
+	std::optional<std::uint64_t> storage_id = m_Printer->Storage().UploadStreamed(filename, std::move(stream), print, OnUploaded);
+
+	if (!storage_id.has_value()) {
+		UntrackUpload(id);
+		return std::nullopt;
+	}
+
+	OnUploadQueued(id, storage_id.value());
+
+	return id;
+}
+
+std::string OctoPrintInterface::MakeUploadCreated(std::uint64_t upload, const std::string &location)const {
+	auto it = std::find_if(m_Uploads.begin(), m_Uploads.end(), [upload](const auto &tracked) { return tracked.Id == upload; });
+
+	nlohmann::json file = {
+		{"name", it != m_Uploads.end() ? it->Filename : std::string()},
+		{"origin", "local"},
+		{"refs", {{"resource", location}}}
+	};
+
+	// Stored here, the printer upload is followed through /api/job or the resource
+	return nlohmann::json{
+		{"done", true},
+		{"files", {{"local", std::move(file)}}},
+		{"job", {{"id", upload}}}
+	}.dump();
+}
+
+std::string OctoPrintInterface::GetJob() {
+	RefreshUploads();
+
+	auto it = std::find_if(m_Uploads.begin(), m_Uploads.end(), [](const auto &upload) { return !upload.Finished; });
+
+	const OctoPrintUpload *upload = it != m_Uploads.end() ? &*it : m_Uploads.size() ? &m_Uploads.back() : nullptr;
+
+	if (!upload) {
+		return nlohmann::json{
+			{"job", {{"file", {{"name", nullptr}, {"origin", nullptr}, {"size", nullptr}}}}},
+			{"progress", {{"completion", nullptr}, {"filepos", nullptr}}},
+			{"state", "Operational"}
+		}.dump();
+	}
+
+	nlohmann::json upload_json = UploadToJson(*upload);
+
+	return nlohmann::json{
+		{"job", {{"id", upload->Id}, {"file", {{"name", upload->Filename}, {"origin", "local"}, {"size", upload_json["size"]}}}}},
+		{"progress", {{"completion", upload_json["completion"]}, {"filepos", upload_json["filepos"]}}},
+		{"state", upload->Finished ? std::string("Operational") : upload->Status.Name()},
+		{"upload", std::move(upload_json)}
+	}.dump();
+}
+
+std::optional<std::string> OctoPrintInterface::GetFileLocal(const std::string &filename, const std::string &location) {
+	RefreshUploads();
+
+	const OctoPrintUpload *upload = FindUpload(filename);
+	const GCodeFileMetadata *metadata = m_Printer->Storage().GetMetadata(filename);
+
+	if(!upload && !metadata)
+		return std::nullopt;
+
+	nlohmann::json file = {
+		{"name", filename},
+		{"origin", "local"},
+		{"refs", {{"resource", location}}}
+	};
+
+	if(metadata)
+		file["size"] = metadata->BytesSize;
+
+	if(upload)
+		file["upload"] = UploadToJson(*upload);
+
+	return file.dump();
+}
+
+std::uint64_t OctoPrintInterface::TrackUpload(const std::string &filename) {
+	while(m_Uploads.size() >= MaxTrackedUploads && m_Uploads.front().Finished)
+		m_Uploads.pop_front();
+
+	OctoPrintUpload &upload = m_Uploads.emplace_back();
+	upload.Id = ++m_LastUploadId;
+	upload.Filename = filename;
+
+	return upload.Id;
+}
+
+void OctoPrintInterface::UntrackUpload(std::uint64_t id) {
+	auto it = std::find_if(m_Uploads.begin(), m_Uploads.end(), [id](const auto &upload) { return upload.Id == id; });
+
+	if(it != m_Uploads.end())
+		m_Uploads.erase(it);
+}
+
+void OctoPrintInterface::OnUploadQueued(std::uint64_t id, std::uint64_t storage_id) {
+	OctoPrintUpload *upload = FindUpload(id);
+
+	if(!upload)
+		return;
+
+	upload->StorageId = storage_id;
+	// Next poll has to see it in storage state
+	m_UploadsRefreshed = {};
+}
+
+void OctoPrintInterface::OnUploadFinished(std::uint64_t id, bool success) {
+	OctoPrintUpload *upload = FindUpload(id);
+
+	if(!upload)
+		return;
+
+	upload->Finished = true;
+	upload->Status = success ? PrinterStorageUploadStatus::Success : PrinterStorageUploadStatus::Failure;
+
+	if(success)
+		upload->Current = upload->Target;
+
+	if(!success && upload->Error.empty())
+		upload->Error = "Upload failed";
+}
+
+void OctoPrintInterface::RefreshUploads() {
+	auto now = std::chrono::steady_clock::now();
+
+	if(now - m_UploadsRefreshed < SnapshotMaxAge)
+		return;
+
+	m_UploadsRefreshed = now;
+
+	std::optional<PrinterStorageUploadState> state = m_Printer->Storage().GetUploadState();
+
+	for (auto &upload : m_Uploads) {
+		// Not handed to storage yet counts as queued, finished ones keep what their callback reported
+		if(upload.Finished || !upload.StorageId.has_value() || !state.has_value())
+			continue;
+
+		if (state->Id == upload.StorageId.value()) {
+			upload.Status = state->Status;
+			upload.Current = state->Current;
+			upload.Target = state->Target;
+			upload.Attempt = state->Attempt;
+			upload.Error = state->Error;
+			continue;
+		}
+
+		bool queued = std::any_of(state->Queue.begin(), state->Queue.end(), [&upload](const auto &waiting) { return waiting.Id == upload.StorageId.value(); });
+
+		if (queued) {
+			upload.Status = PrinterStorageUploadStatus::Queued;
+			upload.Current = 0;
+		}
+	}
+}
+
+const OctoPrintUpload *OctoPrintInterface::FindUpload(const std::string &filename)const {
+	auto it = std::find_if(m_Uploads.rbegin(), m_Uploads.rend(), [&filename](const auto &upload) { return upload.Filename == filename; });
+
+	return it != m_Uploads.rend() ? &*it : nullptr;
+}
+
+OctoPrintUpload *OctoPrintInterface::FindUpload(std::uint64_t id) {
+	auto it = std::find_if(m_Uploads.begin(), m_Uploads.end(), [id](const auto &upload) { return upload.Id == id; });
+
+	return it != m_Uploads.end() ? &*it : nullptr;
+}
+
+nlohmann::json OctoPrintInterface::UploadToJson(const OctoPrintUpload &upload) {
+	nlohmann::json json = {
+		{"id", upload.Id},
+		{"status", upload.Status.Name()},
+		{"completion", upload.Target ? 100.0 * upload.Current / upload.Target : upload.Status == PrinterStorageUploadStatus::Success ? 100.0 : 0.0},
+		{"filepos", upload.Current},
+		{"size", upload.Target ? nlohmann::json(upload.Target) : nlohmann::json(nullptr)},
+		{"attempt", upload.Attempt}
+	};
+
+	if(upload.Error.size())
+		json["error"] = upload.Error;
+
+	return json;
+}
+
+void OctoPrintInterface::Accept() {
+	m_Acceptor.async_accept(boost::beast::bind_front_handler(&OctoPrintInterface::OnAccept, this));
+}
+
+void OctoPrintInterface::OnAccept(boost::beast::error_code ec, boost::asio::ip::tcp::socket socket) {
+	if(ec == boost::asio::error::operation_aborted)
+		return;
+
+	if (ec) {
+		LogOctoPrint(Warning, "Accept failed: %", ec.message());
+	} else {
+		std::make_shared<OctoPrintSession>(*this, std::move(socket))->Run();
+	}
+
+	Accept();
+}
@@ -1,21 +1,150 @@
 #pragma once
 
-#include "pch/beauty.hpp"
+#include "pch/std.hpp"
+#include "pch/asio.hpp"
+#include "pch/json.hpp"
 #include "core/async.hpp"
 #include "printers/printer.hpp"
+#include "multipart.hpp"
+#include <fstream>
+#include <deque>
+#include <boost/beast/core/tcp_stream.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http.hpp>
+
+class OctoPrintInterface;
+
+// Upload as slicers see it, polled by the id from the POST response until it is on the printer
+struct OctoPrintUpload {
+    std::uint64_t Id = 0;
+    // Id of the same upload in printer storage, set once storage has queued it
+    std::optional<std::uint64_t> StorageId;
+    std::string Filename;
+    PrinterStorageUploadStatus Status = PrinterStorageUploadStatus::Queued;
+    std::int32_t Current = 0;
+    std::int32_t Target = 0;
+    std::int32_t Attempt = 1;
+    std::string Error;
+    bool Finished = false;
+};
+
+// Requests are read header first, so uploaded files go to a spool file chunk by chunk instead of being buffered whole
+class OctoPrintSession: public std::enable_shared_from_this<OctoPrintSession> {
+    using RequestParser = boost::beast::http::request_parser<boost::beast::http::buffer_body>;
+    using Response = boost::beast::http::response<boost::beast::http::string_body>;
+
+    OctoPrintInterface &m_Owner;
+    boost::beast::tcp_stream m_Stream;
+    boost::beast::flat_buffer m_Buffer;
+    std::optional<RequestParser> m_Request;
+    std::vector<char> m_Chunk;
+    Response m_Response;
+    boost::beast::http::response<boost::beast::http::empty_body> m_Continue;
+
+    std::optional<MultipartParser> m_Multipart;
+    std::string m_PartName;
+    std::string m_Filename;
+    std::string m_Print;
+    // Whole print part was read, value of m_Print is final
+    bool m_PrintSeen = false;
+    std::filesystem::path m_SpoolPath;
+    std::ofstream m_Spool;
+    std::int64_t m_SpoolSize = 0;
+    // Set when the printer upload reads the spool while it is written
+    std::shared_ptr<GCodeUploadStream> m_UploadStream;
+    std::uint64_t m_UploadId = 0;
+public:
+    OctoPrintSession(OctoPrintInterface &owner, boost::asio::ip::tcp::socket &&socket);
+
+    ~OctoPrintSession();
+
+    void Run();
+private:
+    void ReadHeader();
+
+    void OnHeader(boost::beast::error_code ec, std::size_t bytes_transferred);
+
+    bool BeginFilesLocal();
+
+    void OnContinueWritten(boost::beast::error_code ec, std::size_t bytes_transferred);
+
+    void ReadBodyChunk();
+
+    void OnBodyChunk(boost::beast::error_code ec, std::size_t bytes_transferred);
+
+    void OnFilesLocalReceived();
+
+    void RespondCreated();
+
+    void Respond(boost::beast::http::status status, std::string body, bool keep_alive = true);
+
+    void PrepareResponse(boost::beast::http::status status, std::string body, bool keep_alive);
+
+    void WriteResponse();
+
+    void OnWrite(boost::beast::error_code ec, std::size_t bytes_transferred);
+
+    void DiscardSpool();
+};
 
 class OctoPrintInterface {
 private:
-    beauty::application m_BeautyApplication{Async::Context()};
-    beauty::server m_Server{m_BeautyApplication};
+    boost::asio::ip::tcp::acceptor m_Acceptor{Async::Context()};
     
     std::shared_ptr<Printer> m_Printer;
+    std::filesystem::path m_SpoolPath;
+    std::uint64_t m_LastSpoolId = 0;
+
+    // Oldest first, finished ones are dropped once there are too many
+    std::deque<OctoPrintUpload> m_Uploads;
+    std::uint64_t m_LastUploadId = 0;
+    // Slicers poll, storage state is copied at most once per SnapshotMaxAge
+    std::chrono::steady_clock::time_point m_UploadsRefreshed;
 public:
-    OctoPrintInterface(std::shared_ptr<Printer> printer, std::uint16_t port);
+    OctoPrintInterface(std::shared_ptr<Printer> printer, std::uint16_t port, const std::filesystem::path &spool_path);
 	
     void RunAsync();
 
-    void GetVersion(const beauty::request &req, beauty::response &resp);
+    std::string GetVersion()const;
+
+    // Checked before the body is read, so a rejected upload isn't received first
+    bool CanUpload()const;
+
+    std::filesystem::path MakeSpoolPath();
+
+    // Spool file is handed over to the printer storage, returns the upload id
+    std::uint64_t PostFilesLocal(const std::string &filename, const std::filesystem::path &spool, bool print);
+
+    // Printer upload starts before the file is received and reads the stream spool as it grows,
+    // nullopt when it has to be received first and posted with PostFilesLocal
+    std::optional<std::uint64_t> BeginStreamedUpload(const std::string &filename, std::shared_ptr<GCodeUploadStream> stream, bool print);
+
+    // Body of 201 Created for an accepted upload
+    std::string MakeUploadCreated(std::uint64_t upload, const std::string &location)const;
+
+    // Latest unfinished upload, or the last one when all are done
+    std::string GetJob();
+
+    // Tracked upload of the file or the file already on the printer, nullopt if neither
+    std::optional<std::string> GetFileLocal(const std::string &filename, const std::string &location);
+private:
+    void Accept();
+
+    void OnAccept(boost::beast::error_code ec, boost::asio::ip::tcp::socket socket);
+
+    std::uint64_t TrackUpload(const std::string &filename);
+
+    void UntrackUpload(std::uint64_t id);
+
+    void OnUploadQueued(std::uint64_t id, std::uint64_t storage_id);
+
+    void OnUploadFinished(std::uint64_t id, bool success);
+
+    void RefreshUploads();
+
+    const OctoPrintUpload *FindUpload(const std::string &filename)const;
+
+    OctoPrintUpload *FindUpload(std::uint64_t id);
 
-    void PostFilesLocal(const beauty::request &req, beauty::response &resp);
+    static nlohmann::json UploadToJson(const OctoPrintUpload &upload);
 };
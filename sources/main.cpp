@@ -4,6 +4,9 @@
 #include "printer_proxy.hpp"
 #include "simple/tg_logger.hpp"
 #include "config.hpp"
+#include "printers/shui/upload.hpp"
+#include "core/persistence.hpp"
+#include <boost/asio/signal_set.hpp>
 
 std::unique_ptr<SimpleTgLogger> s_Logger;
 
@@ -60,6 +63,9 @@ int main(int argc, char* argv[])
 	s_Logger = std::make_unique<SimpleTgLogger>(Config::LogToken, Config::LogChat, Config::DebugBotName, Config::LogTopic);
 	s_Logger->SetEnabled(Config::LogIsEnabled);
 
+	Persistence::SetSyncPolicy(Config::PersistenceSync);
+	ShuiUpload::GlobalLimit().SetLimit(Config::UploadGlobalRate, Config::UploadGlobalBurst);
+
     PrinterProxy proxy;
     proxy.Listen(2228);
 
@@ -67,7 +73,20 @@ int main(int argc, char* argv[])
 
 	Log("Main", Info, "Started");
 
+	// Stopped on signal instead of being killed, so queued catalog, history and pacing writes still make it to disk
+	boost::asio::signal_set signals(Async::Context(), SIGINT, SIGTERM);
+	signals.async_wait([](const boost::system::error_code &ec, int signal) {
+		if(ec)
+			return;
+
+		Log("Main", Info, "Stopping on signal %", signal);
+
+		Async::Context().stop();
+	});
+
     Async::Run();
 
+	Persistence::Flush();
+
     return 0;
 }
\ No newline at end of file
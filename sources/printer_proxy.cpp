@@ -5,6 +5,7 @@
 #include <bsl/file.hpp>
 #include <bsl/parse.hpp>
 #include "config.hpp"
+#include <chrono>
 
 DEFINE_LOG_CATEGORY(Proxy);
 
@@ -17,6 +18,9 @@ PrinterProxy::PrinterProxy(){
     m_Server.add_route("/api/v1/printers")
 		.get(std::bind(&PrinterProxy::GetPrinters, this, std::placeholders::_1, std::placeholders::_2));
 
+    m_Server.add_route("/api/v1/snapshot")
+		.get(std::bind(&PrinterProxy::GetSnapshot, this, std::placeholders::_1, std::placeholders::_2));
+
     m_Server.add_route("/api/v1/printers/:id")
 		.get(std::bind(&PrinterProxy::GetPrinter, this, std::placeholders::_1, std::placeholders::_2));
 
@@ -34,10 +38,15 @@ PrinterProxy::PrinterProxy(){
 	{
 		auto id = "ttb_1";
 		auto printer = std::make_shared<ShuiPrinter>("192.168.1.179", 8080, Format("./printers/%", id));
+		printer->SetUploadLimit(256 * 1024, 8 * 1024);
+		printer->SetUploadRetries(3);
+		printer->SetGCodeCompaction(Config::CompactGCode);
+		printer->SetArcFitting(Config::ArcTolerance);
+		printer->SetCutThroughUploads(true);
 
 		m_Printers.emplace(id, printer);
 
-		m_Interfaces.push_back(std::make_unique<OctoPrintInterface>(printer, 2229));
+		m_Interfaces.push_back(std::make_unique<OctoPrintInterface>(printer, 2229, Format("./printers/%/spool", id)));
 	}
 	beauty::ws_handler handler;	
 	handler.on_connect = std::bind(&PrinterProxy::WsOnConnect, this, std::placeholders::_1);
@@ -46,6 +55,8 @@ PrinterProxy::PrinterProxy(){
 	handler.on_error = std::bind(&PrinterProxy::WsOnError, this, std::placeholders::_1, std::placeholders::_2);
 
 	m_Server.add_route("/api/v1/ws").ws(std::move(handler));
+
+	m_StateEpoch = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 }
 
 void PrinterProxy::Listen(std::uint16_t port) {
@@ -62,10 +73,12 @@ void PrinterProxy::RunAsync() {
 		printer->RunAsync();
 
 		printer->OnStateChanged = [this, printer, id]() {
+			m_StateVersion++;
 			return BroadcastMessage(id, MessageType::state, StateToJson(printer->GetPrinterState()));
 		};
 
 		printer->Storage().OnUploadStateChanged = [this, printer, id]() {
+			m_StateVersion++;
 			return BroadcastMessage(id, MessageType::upload, StateToJson(printer->Storage().GetUploadState()));
 		};
 	}
@@ -128,6 +141,21 @@ void PrinterProxy::GetPrinter(const beauty::request& req, beauty::response& resp
 	}).dump();
 }
 
+void PrinterProxy::GetSnapshot(const beauty::request& req, beauty::response& resp) {
+	std::string etag = SnapshotETag();
+
+	resp.set(beauty::http::field::etag, etag);
+	resp.set(beauty::http::field::cache_control, "no-cache");
+
+	if (req.base()[beauty::http::field::if_none_match] == etag) {
+		resp.result(beauty::http::status::not_modified);
+		return;
+	}
+
+	resp.set(beauty::content_type::application_json);
+	resp.body() = SnapshotToJson().dump();
+}
+
 void PrinterProxy::GetPreview(const beauty::request& req, beauty::response& resp) {
 	auto id = req.a("id").as_string();
 	auto filename_or_hash = req.a("filename_or_hash").as_string();
@@ -139,7 +167,7 @@ void PrinterProxy::GetPreview(const beauty::request& req, beauty::response& resp
 	const GCodeFileMetadata *metadata = printer->Storage().GetMetadata(filename_or_hash);
 
 	if(!metadata)
-		metadata = printer->Storage().GetMetadata(FromString<std::size_t>(filename_or_hash).value_or(0));
+		metadata = printer->Storage().GetMetadata(FromString<std::uint64_t>(filename_or_hash).value_or(0));
 
 	if(!metadata)
 		throw beauty::http_error::client::not_found();
@@ -147,7 +175,12 @@ void PrinterProxy::GetPreview(const beauty::request& req, beauty::response& resp
 	if(!metadata->Previews.size())
 		throw beauty::http_error::client::not_found();
 
-	resp.body() = metadata->Previews.back().ToPng();
+	auto png = printer->Storage().ReadPreview(metadata->Previews.back());
+
+	if(!png.has_value())
+		throw beauty::http_error::client::not_found();
+
+	resp.body() = std::move(png.value());
 	resp.set(beauty::content_type::image_png);
 }
 
@@ -162,7 +195,7 @@ void PrinterProxy::GetMetadata(const beauty::request& req, beauty::response& res
 	const GCodeFileMetadata *metadata = printer->Storage().GetMetadata(filename_or_hash);
 
 	if(!metadata)
-		metadata = printer->Storage().GetMetadata(FromString<std::size_t>(filename_or_hash).value_or(0));
+		metadata = printer->Storage().GetMetadata(FromString<std::uint64_t>(filename_or_hash).value_or(0));
 
 	if(!metadata)
 		throw beauty::http_error::client::not_found();
@@ -209,6 +242,12 @@ void PrinterProxy::OnSet(const std::string& id, const nlohmann::json& content) {
 		if (set.property == "feedrate") {
 			printer->SetFeedRatePercentAsync(set.value);
 		}
+		if (set.property == "cancel_upload") {
+			printer->Storage().CancelUpload(set.value);
+		}
+		if (set.property == "force_upload") {
+			printer->Storage().ForceUpload(set.value);
+		}
 	}catch (const std::exception &e) {
 		LogProxy(Error, "OnSet: %", e.what());
 	}
@@ -217,12 +256,8 @@ void PrinterProxy::OnSet(const std::string& id, const nlohmann::json& content) {
 void PrinterProxy::WsOnConnect(const beauty::ws_context& ctx) {
 	m_Sessions[ctx.uuid] = ctx.ws_session;
 	
-	for (const auto& [id, printer] : m_Printers) {
-		SendMessage(ctx.ws_session, id, MessageType::init, nullptr);
-
-		if(printer->IsConnected())
-			SendMessage(ctx.ws_session, id, MessageType::state, StateToJson(printer->GetPrinterState()));
-	}
+	// Whole fleet in one frame, per printer state and upload messages follow as deltas
+	SendMessage(ctx.ws_session, "", MessageType::snapshot, SnapshotToJson());
 }
 
 void PrinterProxy::WsOnReceive(const beauty::ws_context& ctx, const char* data, std::size_t size, bool is_text) {
@@ -293,6 +328,7 @@ nlohmann::json PrinterProxy::StateToJson(const std::optional<PrinterState>& stat
 	state_json["print"]["status"] = print.Status.Name();
 	state_json["print"]["bytes_current"] = print.CurrentBytesPrinted;
 	state_json["print"]["bytes_target"] = print.TargetBytesPrinted;
+	state_json["print"]["remaining"] = print.RemainingSeconds.has_value() ? nlohmann::json(print.RemainingSeconds.value()) : nlohmann::json(nullptr);
 
 	return state_json;
 }
@@ -304,14 +340,62 @@ nlohmann::json PrinterProxy::StateToJson(const std::optional<PrinterStorageUploa
 		return state_json;
 	}
 
+	state_json["id"] = state_opt->Id;
 	state_json["filename"] = state_opt->Filename;
 	state_json["current"] = state_opt->Current;
 	state_json["target"] = state_opt->Target;
 	state_json["status"] = state_opt->Status.Name();
+	state_json["attempt"] = state_opt->Attempt;
+	state_json["attempts"] = state_opt->MaxAttempts;
+
+	if(state_opt->Error.size())
+		state_json["error"] = state_opt->Error;
+
+	nlohmann::json queue = nlohmann::json::array();
+
+	for (std::size_t i = 0; i < state_opt->Queue.size(); i++) {
+		const auto &queued = state_opt->Queue[i];
+
+		queue.push_back({
+			{"id", queued.Id},
+			{"filename", queued.Filename},
+			{"position", i + 1},
+			{"force", queued.Force}
+		});
+	}
+
+	state_json["queue"] = std::move(queue);
 
 	return state_json;
 }
 
+nlohmann::json PrinterProxy::PrinterToJson(Printer& printer) {
+	return nlohmann::json::object({
+		{"model", printer.Model},
+		{"manufacturer", printer.Manufacturer},
+		{"connected", printer.IsConnected()},
+		{"state", StateToJson(printer.GetPrinterState())},
+		{"upload", StateToJson(printer.Storage().GetUploadState())},
+	});
+}
+
+nlohmann::json PrinterProxy::SnapshotToJson()const {
+	nlohmann::json printers = nlohmann::json::object();
+
+	for (const auto& [id, printer] : m_Printers) {
+		printers[id] = PrinterToJson(*printer);
+	}
+
+	return nlohmann::json::object({
+		{"version", m_StateVersion},
+		{"printers", printers}
+	});
+}
+
+std::string PrinterProxy::SnapshotETag()const {
+	return Format("\"%-%\"", m_StateEpoch, m_StateVersion);
+}
+
 std::vector<std::string> PrinterProxy::PrintersIds()const {
 	std::vector<std::string> result;
 
@@ -12,7 +12,7 @@
 
 
 BSL_ENUM(MessageType,
-    init,
+    snapshot,
     state,
     upload
 );
@@ -45,6 +45,10 @@ private:
     std::vector<std::unique_ptr<OctoPrintInterface>> m_Interfaces;
 
     std::map<std::string, std::weak_ptr<beauty::websocket_session>> m_Sessions;
+
+    // Bumped on every printer or upload state change, ETag of the snapshot endpoint
+    std::uint64_t m_StateVersion = 0;
+    std::int64_t m_StateEpoch = 0;
 public:
     PrinterProxy();
 
@@ -60,6 +64,8 @@ public:
 
     void GetPrinter(const beauty::request &req, beauty::response &resp);
 
+    void GetSnapshot(const beauty::request &req, beauty::response &resp);
+
     void GetPreview(const beauty::request &req, beauty::response &resp);
 
     void GetMetadata(const beauty::request &req, beauty::response &resp);
@@ -81,6 +87,12 @@ public:
     static nlohmann::json StateToJson(const std::optional<PrinterState> &state);
     static nlohmann::json StateToJson(const std::optional<PrinterStorageUploadState> &state);
 
+    static nlohmann::json PrinterToJson(Printer &printer);
+
+    nlohmann::json SnapshotToJson()const;
+
+    std::string SnapshotETag()const;
+
     std::vector<std::string> PrintersIds()const;
 
 };
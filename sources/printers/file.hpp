@@ -2,7 +2,6 @@
 
 #include "pch/std.hpp"
 #include "pch/json.hpp"
-#include "core/image.hpp"
 
 struct GCodeFileFilament {
 	std::string Type;
@@ -15,10 +14,18 @@ struct GCodeFileFilament {
 	float EstimatedCost;
 };
 
+// Png bytes of embedded preview, kept outside of metadata so it is never decoded unless needed
+struct GCodePreviewRef {
+	std::int64_t Offset = 0;
+	std::int64_t Size = 0;
+
+	NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(GCodePreviewRef, Offset, Size)
+};
+
 struct GCodeFileMetadata {
 	std::int64_t BytesSize = 0;
 
-	std::vector<Image> Previews;
+	std::vector<GCodePreviewRef> Previews;
 	//std::uint64_t SlicedAtUnixtime;
 	std::int64_t EstimatedPrintTime;
 
@@ -43,10 +50,7 @@ struct GCodeFileMetadata {
 	
 	NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(GCodeFileMetadata, BytesSize, Previews, Layers, Height, Toolchanges, Objects, EnableSupports, NozzleDiameter, EstimatedPrintTime)
 
-	static std::vector<Image> GetPreviews(const std::string& content);
-
-	static GCodeFileMetadata ParseFromGCode(const std::string &content);
-
-	static std::optional<GCodeFileMetadata> ParseFromJsonFile(const std::filesystem::path& filepath);
+	// Metadata files from before the catalog kept previews inline as base64 png
+	static std::optional<GCodeFileMetadata> ParseFromLegacyJsonFile(const std::filesystem::path& filepath, std::vector<std::string> &png_previews);
 };
 
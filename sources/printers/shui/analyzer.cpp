@@ -0,0 +1,216 @@
+#include "analyzer.hpp"
+#include "core/string_utils.hpp"
+#include "core/base64.hpp"
+#include <bsl/log.hpp>
+
+DEFINE_LOG_CATEGORY(GCodeAnalyzer)
+
+void GCodeAnalyzer::Feed(std::string_view chunk) {
+    while (chunk.size()) {
+        auto separator = chunk.find('\n');
+
+        if (separator == std::string_view::npos) {
+            m_PartialLine.append(chunk);
+            m_BytesConsumed += chunk.size();
+            return;
+        }
+
+        std::string_view line = chunk.substr(0, separator);
+        m_BytesConsumed += separator + 1;
+
+        if (m_PartialLine.size()) {
+            m_PartialLine.append(line);
+            OnLine(m_PartialLine, m_BytesConsumed);
+            m_PartialLine.clear();
+        } else {
+            OnLine(line, m_BytesConsumed);
+        }
+
+        chunk.remove_prefix(separator + 1);
+    }
+}
+
+GCodeAnalysis GCodeAnalyzer::Finish() {
+    // Unterminated last line is indexed as if it had a separator, same as StringStream
+    if (m_PartialLine.size()) {
+        OnLine(m_PartialLine, m_BytesConsumed + 1);
+        m_PartialLine.clear();
+    }
+
+    m_Analysis.Metadata.BytesSize = m_BytesConsumed;
+
+    return std::move(m_Analysis);
+}
+
+GCodeAnalysis GCodeAnalyzer::Analyze(std::string_view content) {
+    GCodeAnalyzer analyzer;
+    analyzer.Feed(content);
+    return analyzer.Finish();
+}
+
+void GCodeAnalyzer::OnLine(std::string_view line, std::int64_t next_line_offset) {
+    if(ParsePreviewLine(line))
+        return;
+
+    try{
+        ParseRuntimeLine(line, next_line_offset);
+
+        // Every metadata key starts with ';', so searching from the first one is enough
+        if (auto comment = line.find(';'); comment != std::string_view::npos)
+            ParseMetadataComment(line.substr(comment));
+    }
+    catch (const std::exception &e) {
+        LogGCodeAnalyzer(Error, "Parse failed: %", e.what());
+    }
+}
+
+void GCodeAnalyzer::OnSourceLine(std::string_view line) {
+    if(ParsePreviewLine(line))
+        return;
+
+    try{
+        if (auto comment = line.find(';'); comment != std::string_view::npos)
+            ParseMetadataComment(line.substr(comment));
+    }
+    catch (const std::exception &e) {
+        LogGCodeAnalyzer(Error, "Parse failed: %", e.what());
+    }
+}
+
+void GCodeAnalyzer::OnOutputLine(std::string_view line, std::int64_t next_line_offset) {
+    try{
+        ParseRuntimeLine(line, next_line_offset);
+    }
+    catch (const std::exception &e) {
+        LogGCodeAnalyzer(Error, "Parse failed: %", e.what());
+    }
+}
+
+bool GCodeAnalyzer::ParsePreviewLine(std::string_view line) {
+    static constexpr std::string_view ThumbnailBegin = "; thumbnail begin ";
+    static constexpr std::string_view ThumbnailEnd = "; thumbnail end";
+    static constexpr std::string_view LinePrefix = "; ";
+
+    if (line.starts_with(ThumbnailEnd)) {
+        static constexpr std::string_view PngSignature = "\x89PNG\r\n\x1a\n";
+
+        // Kept encoded, only the one sent to the printer ever needs decoding
+        std::string png = Base64::Decode(m_PreviewData);
+
+        if (png.starts_with(PngSignature)) {
+            m_Analysis.Previews.push_back(std::move(png));
+        }
+        m_PreviewData.clear();
+        m_ReadingPreview = false;
+        return true;
+    }
+
+    if (line.starts_with(ThumbnailBegin)) {
+        m_PreviewData.clear();
+        m_ReadingPreview = true;
+        return true;
+    }
+
+    if(!m_ReadingPreview)
+        return false;
+
+    if(line.starts_with(LinePrefix))
+        line = line.substr(LinePrefix.size());
+
+    m_PreviewData.append(line);
+    return true;
+}
+
+void GCodeAnalyzer::ParseMetadataComment(std::string_view comment) {
+    GCodeFileMetadata &metadata = m_Analysis.Metadata;
+
+    if (auto value = SubstrAfter(comment, "; total layer number: "); value.size()) {
+        metadata.Layers = std::stoi(std::string(value));
+    }
+
+    if (auto value = SubstrAfter(comment, "; max_z_height: "); value.size()) {
+        metadata.Height = std::stof(std::string(value));
+    }
+
+    if (auto value = SubstrAfter(comment, ";TOTAL_TOOLCHANGES:"); value.size()) {
+        metadata.Toolchanges = std::stoi(std::string(value));
+    }
+
+    if (auto value = SubstrAfter(comment, ";NUM_INSTANCES:"); value.size()) {
+        metadata.Objects = std::stoi(std::string(value));
+    }
+
+    if (auto value = SubstrAfter(comment, "; enable_support = "); value.size()) {
+        metadata.EnableSupports = std::stoi(std::string(value));
+    }
+
+    if (auto value = SubstrAfter(comment, "; nozzle_diameter = "); value.size()) {
+        metadata.NozzleDiameter = std::stof(std::string(value));
+    }
+
+    if (auto value = SubstrAfter(comment, "; estimated printing time (normal mode) = "); value.size()) {
+        std::int32_t print_time = 0;
+
+        std::string number;
+        
+        for (char ch : value) {
+            if (std::isdigit(ch)) {
+                number += ch;
+            }
+
+            if ((ch == 'h' || ch == 'm' || ch == 's') && number.size()) {
+                auto units = std::stoi(number);
+
+                if(ch == 's')
+                    print_time += units;
+                if(ch == 'm')
+                    print_time += units * 60;
+                if(ch == 'h')
+                    print_time += units * 60 * 60;
+
+                number.clear();
+            }
+        }
+
+        metadata.EstimatedPrintTime = print_time;
+    }
+}
+
+void GCodeAnalyzer::ParseRuntimeLine(std::string_view line, std::int64_t next_line_offset) {
+    static constexpr std::string_view SetPrintProgressPrefix = "M73 ";
+    static constexpr std::string_view SetPrintLayerPrefix = "M2033.1 L";
+    static constexpr std::string_view SetPrintHeightPrefix = ";Z:";
+
+    GCodeRuntimeState new_state = m_RuntimeState;
+
+    // M73 P<percent> R<minutes left>, either can be omitted
+    if (line.starts_with(SetPrintProgressPrefix)){
+        std::string_view args = line.substr(SetPrintProgressPrefix.size());
+        args = args.substr(0, args.find(';'));
+
+        while (args.size()) {
+            std::string_view arg = args.substr(0, args.find(' '));
+            args.remove_prefix(std::min(arg.size() + 1, args.size()));
+
+            if(arg.starts_with('P'))
+                new_state.Percent = std::stoi(std::string(arg.substr(1)));
+
+            if(arg.starts_with('R'))
+                new_state.RemainingMinutes = std::stoi(std::string(arg.substr(1)));
+        }
+    }
+    
+    if (line.starts_with(SetPrintLayerPrefix)){
+        new_state.Layer = std::stoi(std::string(line.substr(SetPrintLayerPrefix.size())));
+    }
+    
+    if (line.starts_with(SetPrintHeightPrefix)){
+        new_state.Height = std::round(std::stof(std::string(line.substr(SetPrintHeightPrefix.size()))) * 10.f) / 10.f;
+    }
+
+    if (new_state != m_RuntimeState) {
+        m_RuntimeState = new_state;
+        m_Analysis.RuntimeData.Index.push_back(next_line_offset);
+        m_Analysis.RuntimeData.States.push_back(m_RuntimeState);
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "pch/std.hpp"
+#include "printers/file.hpp"
+#include "runtime_data.hpp"
+
+struct GCodeAnalysis {
+	GCodeFileMetadata Metadata;
+	GCodeFileRuntimeData RuntimeData;
+	// Png bytes as embedded by slicer, in file order
+	std::vector<std::string> Previews;
+};
+
+// Collects previews, metadata and runtime index in one pass,
+// content can be fed in chunks of any size as it arrives
+class GCodeAnalyzer {
+	GCodeAnalysis m_Analysis;
+	GCodeRuntimeState m_RuntimeState;
+
+	std::string m_PartialLine;
+	std::int64_t m_BytesConsumed = 0;
+
+	bool m_ReadingPreview = false;
+	std::string m_PreviewData;
+public:
+	void Feed(std::string_view chunk);
+
+	GCodeAnalysis Finish();
+
+	static GCodeAnalysis Analyze(std::string_view content);
+
+	// Line by line feed for transforms, so analysis is made in the same pass: lines they read give metadata and previews,
+	// lines they write give the runtime index with offsets into their output. BytesSize is then left to the caller
+	void OnSourceLine(std::string_view line);
+
+	void OnOutputLine(std::string_view line, std::int64_t next_line_offset);
+private:
+	void OnLine(std::string_view line, std::int64_t next_line_offset);
+
+	bool ParsePreviewLine(std::string_view line);
+
+	void ParseMetadataComment(std::string_view comment);
+
+	void ParseRuntimeLine(std::string_view line, std::int64_t next_line_offset);
+};
@@ -0,0 +1,380 @@
+#include "arc_fitter.hpp"
+#include "analyzer.hpp"
+#include "core/string_utils.hpp"
+#include <cmath>
+#include <numbers>
+
+static constexpr std::size_t MinSegments = 3;
+// Bounds refit cost, longer arcs are split into several
+static constexpr std::size_t MaxSegments = 128;
+// Small circles are where the printer's own segmentation gets coarse, huge ones are lines with float noise
+static constexpr double MinRadius = 0.5;
+static constexpr double MaxRadius = 1000.0;
+// Firmware spreads E evenly along the arc, so every merged move has to extrude at about the same rate
+static constexpr double ExtrusionRateTolerance = 0.05;
+
+static double Distance(double x0, double y0, double x1, double y1) {
+    return std::hypot(x1 - x0, y1 - y0);
+}
+
+GCodeArcFitter::GCodeArcFitter(double tolerance):
+    m_Tolerance(tolerance)
+{}
+
+std::string GCodeArcFitter::Fit(std::string_view content, double tolerance, GCodeArcFitStats *stats, GCodeAnalyzer *source_analyzer, GCodeAnalyzer *output_analyzer) {
+    GCodeArcFitter fitter(tolerance);
+    fitter.m_Result.reserve(content.size());
+    fitter.m_OutputAnalyzer = output_analyzer;
+
+    while (content.size()) {
+        auto separator = content.find('\n');
+        std::string_view line = content.substr(0, separator);
+
+        if(source_analyzer)
+            source_analyzer->OnSourceLine(line);
+
+        fitter.OnLine(line);
+
+        content.remove_prefix(separator == std::string_view::npos ? content.size() : separator + 1);
+    }
+
+    fitter.Flush();
+
+    if(stats)
+        *stats = fitter.m_Stats;
+
+    return std::move(fitter.m_Result);
+}
+
+void GCodeArcFitter::OnLine(std::string_view line) {
+    line = Trim(line);
+
+    if (std::optional<Segment> segment = ParseSegment(line)) {
+        // Feed rate change can only start a run, arc has one feed rate
+        if(segment->FeedRate.has_value() && m_Run.size())
+            Flush();
+
+        AddSegment(segment.value());
+        return;
+    }
+
+    Flush();
+
+    UpdateState(line);
+
+    if(!line.size())
+        return;
+
+    m_Result.append(line).push_back('\n');
+
+    // Merged and fitted moves never switch runtime state, only lines passed through can
+    if(m_OutputAnalyzer)
+        m_OutputAnalyzer->OnOutputLine(line, m_Result.size());
+}
+
+std::optional<GCodeArcFitter::Segment> GCodeArcFitter::ParseSegment(std::string_view line)const {
+    if(!m_Position.has_value() || !m_AbsolutePosition || (m_AbsoluteExtrusion && !m_E.has_value()))
+        return std::nullopt;
+
+    std::string_view code = Trim(line.substr(0, line.find(';')));
+
+    if(!code.starts_with("G1 "))
+        return std::nullopt;
+
+    Segment segment;
+    segment.End = m_Position.value();
+    segment.Line = line;
+
+    std::optional<double> e;
+    bool moves = false;
+
+    std::string_view args = code.substr(3);
+
+    while (args.size()) {
+        auto space = args.find(' ');
+        std::string_view arg = args.substr(0, space);
+        args = space == std::string_view::npos ? std::string_view() : Trim(args.substr(space + 1));
+
+        if(!arg.size())
+            continue;
+
+        std::optional<double> value = ParseDouble(arg.substr(1));
+
+        if(!value.has_value())
+            return std::nullopt;
+
+        switch (arg.front()) {
+        case 'X':
+            segment.End.X = value.value();
+            moves = true;
+            break;
+        case 'Y':
+            segment.End.Y = value.value();
+            moves = true;
+            break;
+        case 'E':
+            e = value;
+            break;
+        case 'F':
+            segment.FeedRate = value;
+            break;
+        default:
+            // Z changes and anything unusual are left alone
+            return std::nullopt;
+        }
+    }
+
+    if(!moves || !e.has_value())
+        return std::nullopt;
+
+    segment.Extruded = m_AbsoluteExtrusion ? e.value() - m_E.value() : e.value();
+    segment.EndE = m_AbsoluteExtrusion ? e.value() : 0;
+
+    // Travels and retractions stay as they are
+    if(segment.Extruded <= 0)
+        return std::nullopt;
+
+    const Point &from = m_Position.value();
+    segment.Length = Distance(from.X, from.Y, segment.End.X, segment.End.Y);
+
+    if(segment.Length <= 0)
+        return std::nullopt;
+
+    return segment;
+}
+
+void GCodeArcFitter::AddSegment(const Segment &segment) {
+    if(m_Run.size() >= MaxSegments && m_RunCircle.has_value())
+        EmitArc(m_Run.size());
+
+    if(!m_Run.size())
+        m_RunStart = m_Position.value();
+
+    m_Run.push_back(segment);
+    m_RunLength += segment.Length;
+
+    m_Position = segment.End;
+    if(m_AbsoluteExtrusion)
+        m_E = segment.EndE;
+
+    if(m_Run.size() < MinSegments)
+        return;
+
+    // Most moves of a real arc fit the circle found so far, refitting is needed only when it drifts
+    if(m_RunCircle.has_value() && Fits(m_RunCircle.value(), m_Run.size() - 1, 1))
+        return;
+
+    if (std::optional<Circle> circle = FitCircle(m_Run.size())) {
+        m_RunCircle = circle;
+        return;
+    }
+
+    if (m_RunCircle.has_value()) {
+        // Previous moves made an arc, the new one starts the next run
+        EmitArc(m_Run.size() - 1);
+        return;
+    }
+
+    // No arc starts at the first move, it is sent as is and the window moves on
+    while (m_Run.size() >= MinSegments && !m_RunCircle.has_value()) {
+        EmitLines(1);
+        m_RunCircle = m_Run.size() >= MinSegments ? FitCircle(m_Run.size()) : std::nullopt;
+    }
+}
+
+void GCodeArcFitter::Flush() {
+    if(m_RunCircle.has_value())
+        EmitArc(m_Run.size());
+
+    EmitLines(m_Run.size());
+}
+
+void GCodeArcFitter::EmitArc(std::size_t count) {
+    const Circle &circle = m_RunCircle.value();
+    const Segment &last = m_Run[count - 1];
+
+    double extruded = 0;
+    for(std::size_t i = 0; i < count; i++)
+        extruded += m_Run[i].Extruded;
+
+    m_Result.append(circle.Clockwise ? "G2" : "G3");
+    m_Result.append(" X");
+    AppendFixed(m_Result, last.End.X, 3);
+    m_Result.append(" Y");
+    AppendFixed(m_Result, last.End.Y, 3);
+    m_Result.append(" I");
+    AppendFixed(m_Result, circle.Center.X - m_RunStart.X, 3);
+    m_Result.append(" J");
+    AppendFixed(m_Result, circle.Center.Y - m_RunStart.Y, 3);
+    m_Result.append(" E");
+    AppendFixed(m_Result, m_AbsoluteExtrusion ? last.EndE : extruded, 5);
+
+    if (m_Run.front().FeedRate.has_value()) {
+        m_Result.append(" F");
+        AppendFixed(m_Result, m_Run.front().FeedRate.value(), 0);
+    }
+
+    m_Result.push_back('\n');
+
+    m_Stats.Arcs++;
+    m_Stats.MergedSegments += count;
+
+    m_RunCircle = std::nullopt;
+    Drop(count);
+}
+
+void GCodeArcFitter::EmitLines(std::size_t count) {
+    for(std::size_t i = 0; i < count; i++)
+        m_Result.append(m_Run[i].Line).push_back('\n');
+
+    Drop(count);
+}
+
+void GCodeArcFitter::Drop(std::size_t count) {
+    if(!count)
+        return;
+
+    m_RunStart = m_Run[count - 1].End;
+    m_Run.erase(m_Run.begin(), m_Run.begin() + count);
+
+    m_RunLength = 0;
+    for(const Segment &segment: m_Run)
+        m_RunLength += segment.Length;
+}
+
+bool GCodeArcFitter::Fits(const Circle &circle, std::size_t from, std::size_t count)const {
+    const Point &center = circle.Center;
+    const double rate = m_Run.front().Extruded / m_Run.front().Length;
+
+    for (std::size_t i = from; i < from + count; i++) {
+        const Point &start = i ? m_Run[i - 1].End : m_RunStart;
+        const Point &end = m_Run[i].End;
+
+        if(std::abs(Distance(center.X, center.Y, end.X, end.Y) - circle.Radius) > m_Tolerance)
+            return false;
+
+        // Arc bulges out of the chord by its sagitta
+        double half = std::min(m_Run[i].Length / 2, circle.Radius);
+        if(circle.Radius - std::sqrt(circle.Radius * circle.Radius - half * half) > m_Tolerance)
+            return false;
+
+        double cross = (start.X - center.X) * (end.Y - center.Y) - (start.Y - center.Y) * (end.X - center.X);
+        if((cross < 0) != circle.Clockwise || cross == 0)
+            return false;
+
+        if(std::abs(m_Run[i].Extruded / m_Run[i].Length - rate) > rate * ExtrusionRateTolerance)
+            return false;
+    }
+
+    // Arc has to stay well short of a full circle, otherwise end close to start reads as a tiny arc
+    return m_RunLength < 2 * std::numbers::pi * circle.Radius * 0.9;
+}
+
+std::optional<GCodeArcFitter::Circle> GCodeArcFitter::FitCircle(std::size_t count)const {
+    // Relative to the start, so squares of big coordinates don't eat precision
+    const Point &a = m_RunStart;
+    double bx = m_Run[count / 2 - 1].End.X - a.X, by = m_Run[count / 2 - 1].End.Y - a.Y;
+    double cx = m_Run[count - 1].End.X - a.X, cy = m_Run[count - 1].End.Y - a.Y;
+
+    double d = 2 * (bx * cy - by * cx);
+
+    if(std::abs(d) < 1e-9)
+        return std::nullopt;
+
+    double b2 = bx * bx + by * by;
+    double c2 = cx * cx + cy * cy;
+
+    Circle circle;
+    circle.Center.X = a.X + (cy * b2 - by * c2) / d;
+    circle.Center.Y = a.Y + (bx * c2 - cx * b2) / d;
+    circle.Radius = Distance(a.X, a.Y, circle.Center.X, circle.Center.Y);
+    circle.Clockwise = d < 0;
+
+    if(circle.Radius < MinRadius || circle.Radius > MaxRadius)
+        return std::nullopt;
+
+    if(!Fits(circle, 0, count))
+        return std::nullopt;
+
+    return circle;
+}
+
+void GCodeArcFitter::UpdateState(std::string_view line) {
+    std::string_view code = Trim(line.substr(0, line.find(';')));
+
+    if(!code.size() || code.front() == ';')
+        return;
+
+    auto space = code.find(' ');
+    std::string_view command = code.substr(0, space);
+    std::string_view args = space == std::string_view::npos ? std::string_view() : code.substr(space + 1);
+
+    if (command == "G90") {
+        m_AbsolutePosition = m_AbsoluteExtrusion = true;
+        return;
+    }
+    if (command == "G91") {
+        m_AbsolutePosition = m_AbsoluteExtrusion = false;
+        return;
+    }
+    if (command == "M82") {
+        m_AbsoluteExtrusion = true;
+        return;
+    }
+    if (command == "M83") {
+        m_AbsoluteExtrusion = false;
+        return;
+    }
+
+    bool move = command == "G0" || command == "G1" || command == "G2" || command == "G3";
+    bool set_position = command == "G92";
+
+    if (!move && !set_position) {
+        // Homing, tool changes and the like leave the head somewhere unknown
+        if(std::toupper((unsigned char)command.front()) == 'G' || std::toupper((unsigned char)command.front()) == 'T' || command == "M600")
+            m_Position = std::nullopt;
+        return;
+    }
+
+    if (set_position && !Trim(args).size()) {
+        m_Position = Point{};
+        m_E = 0.0;
+        return;
+    }
+
+    Point position = m_Position.value_or(Point{});
+    bool has_x = m_Position.has_value(), has_y = m_Position.has_value();
+
+    while (args.size()) {
+        auto next = args.find(' ');
+        std::string_view arg = args.substr(0, next);
+        args = next == std::string_view::npos ? std::string_view() : Trim(args.substr(next + 1));
+
+        if(!arg.size())
+            continue;
+
+        std::optional<double> value = ParseDouble(arg.substr(1));
+        bool absolute = set_position || m_AbsolutePosition;
+
+        switch (arg.front()) {
+        case 'X':
+            position.X = value.value_or(0);
+            has_x = value.has_value() && absolute;
+            break;
+        case 'Y':
+            position.Y = value.value_or(0);
+            has_y = value.has_value() && absolute;
+            break;
+        case 'E':
+            if(value.has_value() && (set_position || m_AbsoluteExtrusion))
+                m_E = value;
+            break;
+        default:
+            if(std::islower((unsigned char)arg.front()))
+                has_x = has_y = false;
+            break;
+        }
+    }
+
+    m_Position = has_x && has_y ? std::optional<Point>(position) : std::nullopt;
+}
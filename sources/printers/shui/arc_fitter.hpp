@@ -0,0 +1,78 @@
+#pragma once
+
+#include "pch/std.hpp"
+
+class GCodeAnalyzer;
+
+struct GCodeArcFitStats {
+	std::int64_t Arcs = 0;
+	// G1 moves replaced by arcs
+	std::int64_t MergedSegments = 0;
+};
+
+// Replaces runs of extruding G1 moves that lie on one circle with G2/G3, total extrusion stays the same.
+// Single pass over lines, a new move is checked against the current circle and the run is refitted only when it doesn't match
+class GCodeArcFitter {
+	struct Point {
+		double X = 0;
+		double Y = 0;
+	};
+
+	struct Circle {
+		Point Center;
+		double Radius = 0;
+		bool Clockwise = false;
+	};
+
+	struct Segment {
+		Point End;
+		double Length = 0;
+		double Extruded = 0;
+		// Absolute E after this move, only meaningful in absolute extrusion mode
+		double EndE = 0;
+		std::optional<double> FeedRate;
+		std::string_view Line;
+	};
+
+	double m_Tolerance = 0;
+	GCodeArcFitStats m_Stats;
+	std::string m_Result;
+
+	GCodeAnalyzer *m_OutputAnalyzer = nullptr;
+
+	std::optional<Point> m_Position;
+	std::optional<double> m_E;
+	bool m_AbsolutePosition = true;
+	bool m_AbsoluteExtrusion = true;
+
+	Point m_RunStart;
+	std::vector<Segment> m_Run;
+	double m_RunLength = 0;
+	// Circle every point of the run fits, set once run is long enough
+	std::optional<Circle> m_RunCircle;
+public:
+	// Analyzers, if given, see lines as they are read and as they are written, see GCodeAnalyzer::OnSourceLine
+	static std::string Fit(std::string_view content, double tolerance, GCodeArcFitStats *stats = nullptr, GCodeAnalyzer *source_analyzer = nullptr, GCodeAnalyzer *output_analyzer = nullptr);
+private:
+	GCodeArcFitter(double tolerance);
+
+	void OnLine(std::string_view line);
+
+	std::optional<Segment> ParseSegment(std::string_view line)const;
+
+	void AddSegment(const Segment &segment);
+
+	void Flush();
+
+	void EmitArc(std::size_t count);
+
+	void EmitLines(std::size_t count);
+
+	void Drop(std::size_t count);
+
+	bool Fits(const Circle &circle, std::size_t from, std::size_t count)const;
+
+	std::optional<Circle> FitCircle(std::size_t count)const;
+
+	void UpdateState(std::string_view line);
+};
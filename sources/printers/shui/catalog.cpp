@@ -0,0 +1,531 @@
+#include "catalog.hpp"
+#include "core/persistence.hpp"
+#include <bsl/log.hpp>
+#include <boost/endian/conversion.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+#define WITH_PROFILE 1
+#include "core/perf.hpp"
+
+DEFINE_LOG_CATEGORY(ShuiCatalog)
+
+// Previews are rewritten once this much of the file is referenced by nothing
+static constexpr std::int64_t MinWastedPreviewBytes = 1024 * 1024;
+static constexpr std::int64_t MaxWastedPreviewShare = 4; // 1/4
+
+// Layout, everything is little-endian:
+//   u32 magic, u32 version, u32 previews generation, u32 files count, u32 metadata count
+//   file:     str 8.3, str long filename, u64 content hash, i32 hash version,
+//             u8 compacted, f32 arc tolerance, i32 preview size, u32 states count, u32 index count, states, index
+//   states:   for each state var percent * 100, var layer, var height * 1000, var remaining minutes
+//   index:    var for each offset
+//   var is zigzag varint of difference with previous value, it is small since states change gradually
+//   metadata: u64 content hash, i64 bytes size, i64 estimated print time, i32 layers, f32 height,
+//             i32 toolchanges, i32 objects, u8 supports, f32 nozzle diameter, u32 previews count, previews (i64 offset, i64 size)
+//   str is u32 size followed by bytes
+
+class CatalogWriter {
+    std::string m_Data;
+public:
+    template<typename T>
+    void Write(T value) {
+        static_assert(std::is_integral_v<T>);
+
+        T little = boost::endian::native_to_little(value);
+        m_Data.append(reinterpret_cast<const char *>(&little), sizeof(little));
+    }
+
+    void Write(bool value) {
+        Write<std::uint8_t>(value);
+    }
+
+    void Write(float value) {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        Write(bits);
+    }
+
+    void Write(const std::string &value) {
+        Write<std::uint32_t>(value.size());
+        m_Data.append(value);
+    }
+
+    void WriteVarint(std::int64_t value) {
+        std::uint64_t zigzag = (std::uint64_t(value) << 1) ^ std::uint64_t(value >> 63);
+
+        do {
+            std::uint8_t byte = zigzag & 0x7f;
+            zigzag >>= 7;
+            m_Data.push_back(char(zigzag ? byte | 0x80 : byte));
+        } while (zigzag);
+    }
+
+    std::string Finish() {
+        return std::move(m_Data);
+    }
+};
+
+class CatalogReader {
+    const char *m_Data = nullptr;
+    std::size_t m_Size = 0;
+    std::size_t m_Offset = 0;
+    bool m_Failed = false;
+public:
+    CatalogReader(const void *data, std::size_t size):
+        m_Data(static_cast<const char *>(data)),
+        m_Size(size)
+    {}
+
+    bool Failed()const {
+        return m_Failed;
+    }
+
+    bool Take(std::size_t size) {
+        if (m_Failed || m_Size - m_Offset < size) {
+            m_Failed = true;
+            return false;
+        }
+
+        m_Offset += size;
+        return true;
+    }
+
+    template<typename T>
+    T Read() {
+        static_assert(std::is_integral_v<T>);
+
+        T value = 0;
+        
+        if(Take(sizeof(T)))
+            std::memcpy(&value, m_Data + m_Offset - sizeof(T), sizeof(T));
+
+        return boost::endian::little_to_native(value);
+    }
+
+    bool ReadBool() {
+        return Read<std::uint8_t>();
+    }
+
+    float ReadFloat() {
+        std::uint32_t bits = Read<std::uint32_t>();
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    std::string ReadString() {
+        std::uint32_t size = Read<std::uint32_t>();
+
+        if(!Take(size))
+            return {};
+
+        return std::string(m_Data + m_Offset - size, size);
+    }
+
+    std::int64_t ReadVarint() {
+        std::uint64_t zigzag = 0;
+
+        for (int shift = 0; shift < 64; shift += 7) {
+            if(!Take(1))
+                return 0;
+
+            std::uint8_t byte = m_Data[m_Offset - 1];
+            zigzag |= std::uint64_t(byte & 0x7f) << shift;
+
+            if(!(byte & 0x80))
+                return std::int64_t(zigzag >> 1) ^ -std::int64_t(zigzag & 1);
+        }
+
+        m_Failed = true;
+        return 0;
+    }
+
+    // Guards allocations against corrupted counts
+    std::uint32_t ReadCount(std::size_t min_element_size) {
+        std::uint32_t count = Read<std::uint32_t>();
+
+        if (!m_Failed && count > (m_Size - m_Offset) / min_element_size) {
+            m_Failed = true;
+            return 0;
+        }
+
+        return count;
+    }
+};
+
+static void WriteEntry(CatalogWriter &writer, const std::string &_83, const GCodeFileEntry &entry) {
+    writer.Write(_83);
+    writer.Write(entry.LongFilename);
+    writer.Write(entry.ContentHash);
+    writer.Write(entry.HashVersion);
+    writer.Write(entry.Transform.Compact);
+    writer.Write(entry.Transform.ArcTolerance);
+    writer.Write(entry.PreviewSize);
+
+    writer.Write<std::uint32_t>(entry.RuntimeData.States.size());
+    writer.Write<std::uint32_t>(entry.RuntimeData.Index.size());
+
+    GCodeRuntimeState previous;
+    for (const GCodeRuntimeState &state : entry.RuntimeData.States) {
+        writer.WriteVarint(std::llround(state.Percent * 100) - std::llround(previous.Percent * 100));
+        writer.WriteVarint(state.Layer - previous.Layer);
+        writer.WriteVarint(std::llround(state.Height * 1000) - std::llround(previous.Height * 1000));
+        writer.WriteVarint(state.RemainingMinutes - previous.RemainingMinutes);
+        previous = state;
+    }
+
+    std::int32_t previous_byte = 0;
+    for (std::int32_t byte : entry.RuntimeData.Index) {
+        writer.WriteVarint(std::int64_t(byte) - previous_byte);
+        previous_byte = byte;
+    }
+}
+
+static void ReadRuntimeData(CatalogReader &reader, GCodeFileRuntimeData &runtime) {
+    std::uint32_t states_count = reader.ReadCount(4);
+    std::uint32_t index_count = reader.ReadCount(1);
+
+    runtime.States.resize(states_count);
+
+    // Deltas start from default state, same as when writing
+    GCodeRuntimeState initial;
+    std::int64_t percent = std::llround(initial.Percent * 100), height = std::llround(initial.Height * 1000), layer = initial.Layer, remaining = initial.RemainingMinutes;
+    for (GCodeRuntimeState &state : runtime.States) {
+        percent += reader.ReadVarint();
+        layer += reader.ReadVarint();
+        height += reader.ReadVarint();
+        remaining += reader.ReadVarint();
+
+        state.Percent = percent / 100.f;
+        state.Layer = layer;
+        state.Height = height / 1000.f;
+        state.RemainingMinutes = remaining;
+    }
+
+    runtime.Index.resize(index_count);
+
+    std::int64_t byte = 0;
+    for (std::int32_t &offset : runtime.Index) {
+        byte += reader.ReadVarint();
+        offset = byte;
+    }
+}
+
+static std::pair<std::string, GCodeFileEntry> ReadEntry(CatalogReader &reader) {
+    std::pair<std::string, GCodeFileEntry> result;
+    auto &[_83, entry] = result;
+
+    _83 = reader.ReadString();
+    entry.LongFilename = reader.ReadString();
+    entry.ContentHash = reader.Read<std::uint64_t>();
+    entry.HashVersion = reader.Read<std::int32_t>();
+    entry.Transform.Compact = reader.ReadBool();
+    entry.Transform.ArcTolerance = reader.ReadFloat();
+    entry.PreviewSize = reader.Read<std::int32_t>();
+
+    ReadRuntimeData(reader, entry.RuntimeData);
+
+    return result;
+}
+
+static void WriteMetadata(CatalogWriter &writer, std::uint64_t content_hash, const GCodeFileMetadata &metadata) {
+    writer.Write(content_hash);
+    writer.Write(metadata.BytesSize);
+    writer.Write(metadata.EstimatedPrintTime);
+    writer.Write(metadata.Layers);
+    writer.Write(metadata.Height);
+    writer.Write(metadata.Toolchanges);
+    writer.Write(metadata.Objects);
+    writer.Write(metadata.EnableSupports);
+    writer.Write(metadata.NozzleDiameter);
+
+    writer.Write<std::uint32_t>(metadata.Previews.size());
+    for (const GCodePreviewRef &preview : metadata.Previews) {
+        writer.Write(preview.Offset);
+        writer.Write(preview.Size);
+    }
+}
+
+static std::pair<std::uint64_t, GCodeFileMetadata> ReadMetadata(CatalogReader &reader) {
+    std::pair<std::uint64_t, GCodeFileMetadata> result;
+    auto &[content_hash, metadata] = result;
+
+    content_hash = reader.Read<std::uint64_t>();
+    metadata.BytesSize = reader.Read<std::int64_t>();
+    metadata.EstimatedPrintTime = reader.Read<std::int64_t>();
+    metadata.Layers = reader.Read<std::int32_t>();
+    metadata.Height = reader.ReadFloat();
+    metadata.Toolchanges = reader.Read<std::int32_t>();
+    metadata.Objects = reader.Read<std::int32_t>();
+    metadata.EnableSupports = reader.ReadBool();
+    metadata.NozzleDiameter = reader.ReadFloat();
+
+    metadata.Previews.resize(reader.ReadCount(16));
+    for (GCodePreviewRef &preview : metadata.Previews) {
+        preview.Offset = reader.Read<std::int64_t>();
+        preview.Size = reader.Read<std::int64_t>();
+    }
+
+    return result;
+}
+
+ShuiCatalog::ShuiCatalog(const std::filesystem::path& data_path):
+    m_DataPath(data_path),
+    m_CatalogPath(data_path / "catalog.bin"),
+    m_PreviewsPath(PreviewsPathFor(0))
+{}
+
+std::filesystem::path ShuiCatalog::PreviewsPathFor(std::uint32_t generation)const {
+    return m_DataPath / (generation ? Format("previews.%.bin", generation) : std::string("previews.bin"));
+}
+
+bool ShuiCatalog::Exists()const {
+    return std::filesystem::exists(m_CatalogPath);
+}
+
+std::optional<ShuiCatalogContent> ShuiCatalog::Read() {
+    PROFILE_SCOPE(ShuiCatalog, Read);
+
+    try{
+        if (!std::filesystem::file_size(m_CatalogPath)) {
+            LogShuiCatalog(Error, "'%' is empty", m_CatalogPath.string());
+            return std::nullopt;
+        }
+
+        boost::interprocess::file_mapping file(m_CatalogPath.string().c_str(), boost::interprocess::read_only);
+        boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+
+        CatalogReader reader(region.get_address(), region.get_size());
+
+        std::uint32_t magic = reader.Read<std::uint32_t>();
+        std::uint32_t version = reader.Read<std::uint32_t>();
+
+        if (magic != Magic || version != Version) {
+            LogShuiCatalog(Error, "'%' has unsupported format, magic: %, version: %", m_CatalogPath.string(), magic, version);
+            return std::nullopt;
+        }
+
+        std::uint32_t previews_generation = reader.Read<std::uint32_t>();
+        std::uint32_t files_count = reader.Read<std::uint32_t>();
+        std::uint32_t metadata_count = reader.Read<std::uint32_t>();
+
+        ShuiCatalogContent content;
+
+        for (std::uint32_t i = 0; i < files_count && !reader.Failed(); i++)
+            content.Files.push_back(ReadEntry(reader));
+
+        for (std::uint32_t i = 0; i < metadata_count && !reader.Failed(); i++)
+            content.Metadata.push_back(ReadMetadata(reader));
+
+        if (reader.Failed()) {
+            LogShuiCatalog(Error, "'%' is truncated", m_CatalogPath.string());
+            return std::nullopt;
+        }
+
+        std::lock_guard<std::mutex> lock(m_PreviewsLock);
+        m_PreviewsGeneration = previews_generation;
+        m_PreviewsPath = PreviewsPathFor(previews_generation);
+
+        return content;
+    }catch (const std::exception &e) {
+        LogShuiCatalog(Error, "Can't read '%': %", m_CatalogPath.string(), e.what());
+        return std::nullopt;
+    }
+}
+
+void ShuiCatalog::Discard()const {
+    auto discarded_path = m_CatalogPath;
+    discarded_path += ".broken";
+
+    std::error_code ec;
+    std::filesystem::rename(m_CatalogPath, discarded_path, ec);
+
+    LogShuiCatalogIf((bool)ec, Error, "Can't move '%' aside: %", m_CatalogPath.string(), ec.message());
+}
+
+std::string ShuiCatalog::Serialize(const std::unordered_map<std::string, GCodeFileEntry>& files, const std::unordered_map<std::uint64_t, GCodeFileMetadata>& metadata)const {
+    PROFILE_SCOPE(ShuiCatalog, Serialize);
+
+    CatalogWriter writer;
+    writer.Write(Magic);
+    writer.Write(Version);
+    writer.Write(m_PreviewsGeneration);
+    writer.Write<std::uint32_t>(files.size());
+    writer.Write<std::uint32_t>(metadata.size());
+
+    for(const auto &[_83, entry]: files)
+        WriteEntry(writer, _83, entry);
+
+    for(const auto &[content_hash, data]: metadata)
+        WriteMetadata(writer, content_hash, data);
+
+    return writer.Finish();
+}
+
+void ShuiCatalog::Write(std::string serialized) {
+    Persistence::Write(m_CatalogPath, std::move(serialized));
+}
+
+bool ShuiCatalog::WriteNow(const std::string& serialized) {
+    PROFILE_SCOPE(ShuiCatalog, WriteNow);
+
+    return Persistence::WriteNow(m_CatalogPath, serialized);
+}
+
+std::optional<GCodePreviewRef> ShuiCatalog::AppendPreview(const std::string& png) {
+    std::lock_guard<std::mutex> lock(m_PreviewsLock);
+
+    std::ofstream file(m_PreviewsPath, std::ios::binary | std::ios::app);
+
+    if (!file.is_open()) {
+        LogShuiCatalog(Error, "Can't open '%'", m_PreviewsPath.string());
+        return std::nullopt;
+    }
+
+    GCodePreviewRef preview;
+    preview.Offset = std::filesystem::file_size(m_PreviewsPath);
+    preview.Size = png.size();
+
+    file.write(png.data(), png.size());
+    file.flush();
+
+    if (!file) {
+        LogShuiCatalog(Error, "Can't append preview to '%'", m_PreviewsPath.string());
+        return std::nullopt;
+    }
+
+    return preview;
+}
+
+// Offsets come from the catalog, a corrupted one must not turn into a huge allocation
+static bool IsInside(const GCodePreviewRef &preview, std::int64_t file_size) {
+    return preview.Offset >= 0 && preview.Size >= 0 && preview.Offset <= file_size && preview.Size <= file_size - preview.Offset;
+}
+
+std::optional<std::string> ShuiCatalog::ReadPreview(const GCodePreviewRef& preview)const {
+    std::filesystem::path path;
+
+    {
+        std::lock_guard<std::mutex> lock(m_PreviewsLock);
+        path = m_PreviewsPath;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+
+    if(!file.is_open())
+        return std::nullopt;
+
+    std::error_code ec;
+    std::int64_t file_size = std::filesystem::file_size(path, ec);
+
+    if (ec || !IsInside(preview, file_size)) {
+        LogShuiCatalog(Warning, "Preview % + % is outside of '%'", preview.Offset, preview.Size, path.string());
+        return std::nullopt;
+    }
+
+    std::string png(preview.Size, '\0');
+
+    if(!file.seekg(preview.Offset) || !file.read(png.data(), png.size()))
+        return std::nullopt;
+
+    return png;
+}
+
+bool ShuiCatalog::CompactPreviews(const std::unordered_map<std::string, GCodeFileEntry> &files, std::unordered_map<std::uint64_t, GCodeFileMetadata> &metadata) {
+    PROFILE_SCOPE(ShuiCatalog, CompactPreviews);
+
+    std::lock_guard<std::mutex> lock(m_PreviewsLock);
+
+    std::error_code ec;
+    std::int64_t file_size = std::filesystem::file_size(m_PreviewsPath, ec);
+
+    if(ec)
+        return false;
+
+    struct Range {
+        std::int64_t Size = 0;
+        std::int64_t NewOffset = 0;
+    };
+
+    // By old offset, read in file order. Previews are appended whole, so one offset is one range
+    std::map<std::int64_t, Range> ranges;
+    std::int64_t referenced = 0;
+
+    for (const auto &[content_hash, data] : metadata) {
+        for (const GCodePreviewRef &preview : data.Previews) {
+            if(IsInside(preview, file_size) && ranges.emplace(preview.Offset, Range{preview.Size}).second)
+                referenced += preview.Size;
+        }
+    }
+
+    std::int64_t wasted = file_size - referenced;
+
+    if(wasted < MinWastedPreviewBytes || wasted < file_size / MaxWastedPreviewShare)
+        return false;
+
+    std::ifstream file(m_PreviewsPath, std::ios::binary);
+    std::string compacted;
+    compacted.reserve(referenced);
+
+    for (auto &[offset, range] : ranges) {
+        range.NewOffset = compacted.size();
+        compacted.resize(compacted.size() + range.Size);
+
+        if (!file.seekg(offset) || !file.read(compacted.data() + range.NewOffset, range.Size)) {
+            LogShuiCatalog(Error, "Can't read '%' for compaction", m_PreviewsPath.string());
+            return false;
+        }
+    }
+
+    file.close();
+
+    auto compacted_metadata = metadata;
+
+    for (auto &[content_hash, data] : compacted_metadata) {
+        std::vector<GCodePreviewRef> kept;
+
+        for (const GCodePreviewRef &preview : data.Previews) {
+            auto it = ranges.find(preview.Offset);
+
+            // Broken references are dropped on the way
+            if(it == ranges.end() || it->second.Size != preview.Size)
+                continue;
+
+            GCodePreviewRef moved = preview;
+            moved.Offset = it->second.NewOffset;
+            kept.push_back(moved);
+        }
+
+        data.Previews = std::move(kept);
+    }
+
+    std::uint32_t old_generation = m_PreviewsGeneration;
+    std::filesystem::path old_path = m_PreviewsPath;
+    std::filesystem::path new_path = PreviewsPathFor(old_generation + 1);
+
+    if(!Persistence::WriteNow(new_path, compacted))
+        return false;
+
+    // Catalog naming the new file is what commits the compaction, a crash before leaves the old pair intact
+    m_PreviewsGeneration = old_generation + 1;
+
+    if (!WriteNow(Serialize(files, compacted_metadata))) {
+        m_PreviewsGeneration = old_generation;
+        std::filesystem::remove(new_path, ec);
+        return false;
+    }
+
+    m_PreviewsPath = new_path;
+    metadata = std::move(compacted_metadata);
+
+    std::filesystem::remove(old_path, ec);
+
+    LogShuiCatalog(Display, "Compacted previews from % to % bytes", file_size, compacted.size());
+
+    return true;
+}
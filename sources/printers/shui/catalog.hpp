@@ -0,0 +1,75 @@
+#pragma once
+
+#include "pch/std.hpp"
+#include "pch/json.hpp"
+#include "printers/file.hpp"
+#include "runtime_data.hpp"
+#include <mutex>
+
+struct GCodeFileEntry {
+	// Empty for files found on the printer that weren't uploaded through proxy
+	std::string LongFilename;
+	std::uint64_t ContentHash = 0;
+	// ContentHasher::Version the hash was made with, 0 is std::hash of preprocessed content
+	std::int32_t HashVersion = 0;
+	GCodeFileRuntimeData RuntimeData;
+	// Index is only reused for content that goes through the same transform
+	GCodeTransform Transform;
+	// Preview block sent in front of the content, index offsets include it
+	std::int32_t PreviewSize = 0;
+
+	bool IsPrinterNative()const {
+		return LongFilename.empty();
+	}
+
+	NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(GCodeFileEntry, LongFilename, ContentHash, HashVersion, RuntimeData, Transform, PreviewSize);
+};
+
+struct ShuiCatalogContent {
+	std::vector<std::pair<std::string, GCodeFileEntry>> Files;
+	std::vector<std::pair<std::uint64_t, GCodeFileMetadata>> Metadata;
+};
+
+// Everything storage knows about uploaded files, kept in one binary file that is read through a single mapping.
+// Previews are png bytes in a separate append-only file, metadata only references them
+class ShuiCatalog {
+	std::filesystem::path m_DataPath;
+	std::filesystem::path m_CatalogPath;
+	// Compaction writes a new previews file, catalog names the one its offsets are for
+	std::uint32_t m_PreviewsGeneration = 0;
+	std::filesystem::path m_PreviewsPath;
+
+	mutable std::mutex m_PreviewsLock;
+public:
+	static constexpr std::uint32_t Magic = 0x54434853; // "SHCT"
+	// Bump on any layout change
+	static constexpr std::uint32_t Version = 1;
+
+	ShuiCatalog(const std::filesystem::path &data_path);
+
+	bool Exists()const;
+
+	// Switches previews to the file the catalog was written with
+	std::optional<ShuiCatalogContent> Read();
+
+	// Moves unreadable catalog aside, so the next write does not lose it
+	void Discard()const;
+
+	std::string Serialize(const std::unordered_map<std::string, GCodeFileEntry> &files, const std::unordered_map<std::uint64_t, GCodeFileMetadata> &metadata)const;
+
+	// Queued to the persistence writer, replaces any catalog still waiting to be written
+	void Write(std::string serialized);
+
+	bool WriteNow(const std::string &serialized);
+
+	// Safe to call from worker threads
+	std::optional<GCodePreviewRef> AppendPreview(const std::string &png);
+
+	std::optional<std::string> ReadPreview(const GCodePreviewRef &preview)const;
+
+	// Rewrites previews without ranges metadata doesn't reference once enough is wasted, offsets in metadata are updated.
+	// Catalog is written right away, must happen before any queued write. False if nothing was done
+	bool CompactPreviews(const std::unordered_map<std::string, GCodeFileEntry> &files, std::unordered_map<std::uint64_t, GCodeFileMetadata> &metadata);
+private:
+	std::filesystem::path PreviewsPathFor(std::uint32_t generation)const;
+};
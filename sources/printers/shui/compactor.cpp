@@ -0,0 +1,210 @@
+#include "compactor.hpp"
+#include "analyzer.hpp"
+#include "core/string_utils.hpp"
+
+static constexpr std::string_view Axes = "XYZE";
+// Only these are numbers that are safe to round, anything else is sent as is
+static constexpr std::string_view Rounded = "XYZEFIJR";
+
+// Digits after the point printer still tells apart, positions in mm and feed rate in mm/min
+static int Precision(char param) {
+    switch (param) {
+    case 'E':
+        return 5;
+    case 'F':
+        return 0;
+    default:
+        return 3;
+    }
+}
+
+static double Round(double value, int precision) {
+    double scale = std::pow(10.0, precision);
+    return std::round(value * scale) / scale;
+}
+
+std::string GCodeCompactor::Compact(std::string_view content, GCodeAnalyzer *source_analyzer, GCodeAnalyzer *output_analyzer) {
+    GCodeCompactor compactor;
+    compactor.m_Result.reserve(content.size());
+    compactor.m_SourceAnalyzer = source_analyzer;
+    compactor.m_OutputAnalyzer = output_analyzer;
+
+    while (content.size()) {
+        auto separator = content.find('\n');
+        std::string_view line = content.substr(0, separator);
+
+        if(source_analyzer)
+            source_analyzer->OnSourceLine(line);
+
+        compactor.OnLine(line);
+
+        content.remove_prefix(separator == std::string_view::npos ? content.size() : separator + 1);
+    }
+
+    return std::move(compactor.m_Result);
+}
+
+void GCodeCompactor::OnLine(std::string_view line) {
+    static constexpr std::string_view ShuiPreviewStart = ";SHUI PREVIEW";
+    static constexpr std::string_view ShuiPreviewEnd = ";End of SHUI PREVIEW";
+
+    line = Trim(line);
+
+    // Preview rows are base64 behind ';', printer reads them as is
+    if (line.starts_with(ShuiPreviewStart) || m_InShuiPreview) {
+        m_InShuiPreview = !line.starts_with(ShuiPreviewEnd);
+        Emit(line);
+        return;
+    }
+
+    if (line.starts_with(';')) {
+        if(KeepComment(line))
+            Emit(line);
+        return;
+    }
+
+    line = Trim(line.substr(0, line.find(';')));
+
+    if(line.size())
+        OnCommand(line);
+}
+
+void GCodeCompactor::Emit(std::string_view line) {
+    m_Result.append(line).push_back('\n');
+
+    if(m_OutputAnalyzer)
+        m_OutputAnalyzer->OnOutputLine(line, m_Result.size());
+}
+
+bool GCodeCompactor::KeepComment(std::string_view line) {
+    static constexpr std::array<std::string_view, 3> Kept = {";Z:", ";gimage:", ";simage:"};
+
+    return std::any_of(Kept.begin(), Kept.end(), [line](std::string_view prefix) { return line.starts_with(prefix); });
+}
+
+void GCodeCompactor::OnCommand(std::string_view line) {
+    auto space = line.find(' ');
+    std::string_view command = line.substr(0, space);
+    std::string_view args = space == std::string_view::npos ? std::string_view() : Trim(line.substr(space + 1));
+    char letter = std::toupper((unsigned char)command.front());
+
+    if (command == "G0" || command == "G1" || command == "G2" || command == "G3") {
+        OnMove(command, args);
+        return;
+    }
+
+    if (command == "G90") {
+        m_AbsolutePosition = m_AbsoluteExtrusion = true;
+    } else if (command == "G91") {
+        m_AbsolutePosition = m_AbsoluteExtrusion = false;
+        ForgetPosition();
+    } else if (command == "M82") {
+        m_AbsoluteExtrusion = true;
+    } else if (command == "M83") {
+        m_AbsoluteExtrusion = false;
+        m_Position[3].reset();
+    } else if (command == "G92") {
+        OnSetPosition(args);
+    } else if (letter == 'G' || letter == 'T' || command == "M600") {
+        // Homing, probing, tool changes and the like move on their own, position is unknown after them
+        ForgetPosition();
+    }
+
+    Emit(line);
+}
+
+void GCodeCompactor::OnMove(std::string_view command, std::string_view args) {
+    bool arc = command == "G2" || command == "G3";
+
+    std::string out(command);
+
+    while (args.size()) {
+        auto space = args.find(' ');
+        std::string_view arg = args.substr(0, space);
+        args = space == std::string_view::npos ? std::string_view() : Trim(args.substr(space + 1));
+
+        if(!arg.size())
+            continue;
+
+        char param = arg.front();
+        std::optional<double> parsed = ParseDouble(arg.substr(1));
+        auto axis = Axes.find(param);
+
+        // Lowercase axis would be a move that can't be tracked
+        if(std::islower((unsigned char)param))
+            ForgetPosition();
+
+        if (!parsed.has_value() || Rounded.find(param) == std::string_view::npos) {
+            out.append(" ").append(arg);
+
+            if(axis != std::string_view::npos)
+                m_Position[axis].reset();
+            continue;
+        }
+
+        double value = Round(parsed.value(), Precision(param));
+
+        if (param == 'F') {
+            if(m_FeedRate == value)
+                continue;
+
+            m_FeedRate = value;
+        } else if (axis != std::string_view::npos) {
+            bool absolute = axis == 3 ? m_AbsoluteExtrusion : m_AbsolutePosition;
+
+            // Arc endpoint equal to start still draws a full circle, so only straight moves drop axes
+            if (!arc) {
+                if(absolute && m_Position[axis] == value)
+                    continue;
+
+                if(!absolute && value == 0)
+                    continue;
+            }
+
+            if(absolute)
+                m_Position[axis] = value;
+            else
+                m_Position[axis].reset();
+        }
+
+        out.push_back(' ');
+        out.push_back(param);
+        AppendFixed(out, value, Precision(param));
+    }
+
+    // Nothing left to move or to set
+    if(out.size() == command.size() && !arc)
+        return;
+
+    Emit(out);
+}
+
+void GCodeCompactor::OnSetPosition(std::string_view args) {
+    if (!args.size()) {
+        m_Position.fill(0.0);
+        return;
+    }
+
+    while (args.size()) {
+        auto space = args.find(' ');
+        std::string_view arg = args.substr(0, space);
+        args = space == std::string_view::npos ? std::string_view() : Trim(args.substr(space + 1));
+
+        auto axis = arg.size() ? Axes.find(arg.front()) : std::string_view::npos;
+
+        if(axis == std::string_view::npos)
+            continue;
+
+        std::optional<double> parsed = ParseDouble(arg.substr(1));
+
+        if(parsed.has_value())
+            m_Position[axis] = Round(parsed.value(), Precision(arg.front()));
+        else
+            m_Position[axis].reset();
+    }
+}
+
+void GCodeCompactor::ForgetPosition() {
+    for(auto &position: m_Position)
+        position.reset();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "pch/std.hpp"
+
+class GCodeAnalyzer;
+
+// Shrinks G-code before it goes over the slow printer link: drops comments printer doesn't use,
+// parameters repeating the current position or feed rate and digits beyond what the printer resolves.
+// Previews, M73, M2033.1 and ;Z: markers are kept, so analysis of the output gives the same runtime states
+class GCodeCompactor {
+	// Known only while in absolute mode and after being set explicitly
+	std::array<std::optional<double>, 4> m_Position;
+	std::optional<double> m_FeedRate;
+	bool m_AbsolutePosition = true;
+	bool m_AbsoluteExtrusion = true;
+
+	bool m_InShuiPreview = false;
+
+	std::string m_Result;
+
+	GCodeAnalyzer *m_SourceAnalyzer = nullptr;
+	GCodeAnalyzer *m_OutputAnalyzer = nullptr;
+public:
+	// Analyzers, if given, see lines as they are read and as they are written, see GCodeAnalyzer::OnSourceLine
+	static std::string Compact(std::string_view content, GCodeAnalyzer *source_analyzer = nullptr, GCodeAnalyzer *output_analyzer = nullptr);
+private:
+	void OnLine(std::string_view line);
+
+	void Emit(std::string_view line);
+
+	bool KeepComment(std::string_view line);
+
+	void OnCommand(std::string_view line);
+
+	void OnMove(std::string_view command, std::string_view args);
+
+	void OnSetPosition(std::string_view args);
+
+	void ForgetPosition();
+};
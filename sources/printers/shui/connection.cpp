@@ -36,8 +36,8 @@ std::int32_t ShuiPrinterConnection::SecondsTimeout()const {
 	return m_SecondsTimeout;
 }
 
-void ShuiPrinterConnection::SubmitGCodeAsync(std::string gcode, GCodeSubmissionState::OnResultType on_result, std::int64_t retries) {
-	m_GCodeEngine.Submit(std::move(gcode), on_result, retries);
+void ShuiPrinterConnection::SubmitGCodeAsync(std::string gcode, GCodeSubmissionState::OnResultType on_result, std::int64_t retries, GCodePriority priority) {
+	m_GCodeEngine.Submit(std::move(gcode), on_result, retries, priority);
 }
 
 void ShuiPrinterConnection::CancelAllGCode() {
@@ -38,12 +38,12 @@ public:
 
 	std::int32_t SecondsTimeout()const;
 
-	void SubmitGCodeAsync(std::string gcode, GCodeSubmissionState::OnResultType on_result = [](auto){}, std::int64_t retries = 0);
+	void SubmitGCodeAsync(std::string gcode, GCodeSubmissionState::OnResultType on_result = [](auto){}, std::int64_t retries = 0, GCodePriority priority = GCodePriority::Normal);
 
 	void CancelAllGCode();
 
-	bool GCodeDone()const {
-		return m_GCodeEngine.AllDone();
+	bool GCodeDone(GCodePriority priority = GCodePriority::Low)const {
+		return m_GCodeEngine.AllDone(priority);
 	}
 
 	void RunAsync();
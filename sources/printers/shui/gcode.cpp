@@ -18,8 +18,23 @@ void GCodeExecutionEngine::VerboseGCodeCallback(std::optional<std::string> resul
 	}
 }
 
-void GCodeExecutionEngine::Submit(std::string gcode, GCodeSubmissionState::OnResultType on_result, std::int64_t retries) {
-	m_SubmittedCommands.push({gcode, on_result, retries});
+void GCodeExecutionEngine::Submit(std::string gcode, GCodeSubmissionState::OnResultType on_result, std::int64_t retries, GCodePriority priority) {
+	m_SubmittedCommands[std::size_t(priority)].push({gcode, on_result, retries});
+}
+
+std::queue<GCodeSubmissionState>* GCodeExecutionEngine::CurrentQueue() {
+	// Command already sent has to finish first, printer answers in order
+	for (auto &commands : m_SubmittedCommands) {
+		if(commands.size() && commands.front().State == GCodeState::Sent)
+			return &commands;
+	}
+
+	for (auto &commands : m_SubmittedCommands) {
+		if(commands.size())
+			return &commands;
+	}
+
+	return nullptr;
 }
 
 bool GCodeExecutionEngine::IsSystemLine(const std::string& line){
@@ -40,11 +55,12 @@ bool GCodeExecutionEngine::IsOkSystemLine(const std::string& line) {
 }
 
 void GCodeExecutionEngine::OnReadingDone(std::int64_t last_index) {
+	auto *commands = CurrentQueue();
 
-	if(!m_SubmittedCommands.size() || last_index <= PreambleLinesCount)
+	if(!commands || last_index <= PreambleLinesCount)
 		return;
 
-	GCodeSubmissionState &current = m_SubmittedCommands.front();
+	GCodeSubmissionState &current = commands->front();
 
 	if(current.State == GCodeState::Enqueued){
 		LogGCodeExecutionIf(!WriteGCode, Error, "GCode writing callback is null");
@@ -60,10 +76,12 @@ void GCodeExecutionEngine::OnReadingDone(std::int64_t last_index) {
 }
 
 void GCodeExecutionEngine::OnLine(const std::string& line, std::int64_t index) {
-	if(!m_SubmittedCommands.size())
+	auto *commands = CurrentQueue();
+
+	if(!commands)
 		return;
 
-	GCodeSubmissionState &current = m_SubmittedCommands.front();
+	GCodeSubmissionState &current = commands->front();
 	if (current.State != GCodeState::Sent)
 		return;
 
@@ -75,7 +93,7 @@ void GCodeExecutionEngine::OnLine(const std::string& line, std::int64_t index) {
 
 		std::call(current.OnResult, result);
 
-		m_SubmittedCommands.pop();
+		commands->pop();
 	};
 
 	auto FinishWithAccumulator = [&]{
@@ -105,6 +123,8 @@ void GCodeExecutionEngine::OnLine(const std::string& line, std::int64_t index) {
 }
 
 void GCodeExecutionEngine::CancelAll() {
-	while(m_SubmittedCommands.size())
-		m_SubmittedCommands.pop();
+	for (auto &commands : m_SubmittedCommands) {
+		while(commands.size())
+			commands.pop();
+	}
 }
\ No newline at end of file
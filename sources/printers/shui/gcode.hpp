@@ -2,6 +2,7 @@
 
 #include "pch/std.hpp"
 #include <queue>
+#include <array>
 
 #define SHUI_VERBOSE_LOGGING 0
 
@@ -10,6 +11,13 @@ enum class GCodeState {
 	Sent	
 };
 
+enum class GCodePriority {
+	// Interactive commands and state reports
+	Normal,
+	// Background work, only sent when nothing more urgent is waiting
+	Low
+};
+
 struct GCodeSubmissionState {
 	using OnResultType = std::function<void(std::optional<std::string>)>;
 
@@ -37,7 +45,10 @@ struct GCodeSubmissionState {
 };
 
 class GCodeExecutionEngine {
-	std::queue<GCodeSubmissionState> m_SubmittedCommands;
+	static constexpr std::size_t PrioritiesCount = 2;
+
+	// Indexed by GCodePriority
+	std::array<std::queue<GCodeSubmissionState>, PrioritiesCount> m_SubmittedCommands;
 
 	static constexpr std::int64_t PreambleLinesCount = 3;
 	static constexpr std::int64_t MaxSystemLinesAfterSubmission = 3;
@@ -49,7 +60,7 @@ public:
 	static void VerboseGCodeCallback(std::optional<std::string> result);
 public:
 
-	void Submit(std::string gcode, GCodeSubmissionState::OnResultType on_result, std::int64_t retries);
+	void Submit(std::string gcode, GCodeSubmissionState::OnResultType on_result, std::int64_t retries, GCodePriority priority = GCodePriority::Normal);
 
 	static bool IsSystemLine(const std::string& line);
 
@@ -63,7 +74,14 @@ public:
 
 	void CancelAll();
 
-	bool AllDone()const {
-		return !m_SubmittedCommands.size();
+	// Nothing of given or more urgent priority is waiting
+	bool AllDone(GCodePriority priority = GCodePriority::Low)const {
+		for (std::size_t i = 0; i <= std::size_t(priority); i++) {
+			if(m_SubmittedCommands[i].size())
+				return false;
+		}
+		return true;
 	}
+private:
+	std::queue<GCodeSubmissionState> *CurrentQueue();
 };
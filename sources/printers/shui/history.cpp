@@ -1,6 +1,7 @@
 #include "history.hpp"
 #include <bsl/file.hpp>
 #include <bsl/log.hpp>
+#include "core/persistence.hpp"
 
 DEFINE_LOG_CATEGORY(ShuiPrinterHistory)
 
@@ -26,7 +27,7 @@ void ShuiPrinterHistory::Load() {
 }
 
 void ShuiPrinterHistory::Save() {
-	File::WriteEntire(m_HistoryPath, nlohmann::json(m_History).dump());
+	Persistence::Write(m_HistoryPath, nlohmann::json(m_History).dump());
 }
 
 void ShuiPrinterHistory::OnStateChanged(std::optional<PrinterState> state){
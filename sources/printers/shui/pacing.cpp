@@ -0,0 +1,104 @@
+#include "pacing.hpp"
+#include <bsl/file.hpp>
+#include <bsl/log.hpp>
+#include "core/persistence.hpp"
+
+DEFINE_LOG_CATEGORY(ShuiUploadPacing)
+
+// Per burst sized write that went through with headroom
+static constexpr double IncreaseStep = 2 * 1024;
+static constexpr double DecreaseFactor = 0.5;
+
+ShuiUploadPacing::ShuiUploadPacing(const std::filesystem::path &path, std::size_t initial_rate, std::size_t max_rate, std::size_t burst):
+	m_Path(path),
+	m_Bucket(initial_rate, burst),
+	m_MaxRate(max_rate),
+	m_Burst(burst),
+	m_Rate(initial_rate)
+{
+	Load();
+}
+
+TokenBucket &ShuiUploadPacing::Bucket() {
+	return m_Bucket;
+}
+
+void ShuiUploadPacing::SetLimit(std::size_t max_rate, std::size_t burst) {
+	std::unique_lock lock(m_Lock);
+
+	m_MaxRate = max_rate;
+	m_Burst = burst;
+	SetRate(m_Rate);
+}
+
+std::size_t ShuiUploadPacing::Rate()const {
+	std::unique_lock lock(m_Lock);
+	return m_Rate;
+}
+
+void ShuiUploadPacing::OnWriteCompleted(std::size_t bytes, Clock::time_point started, Clock::time_point finished) {
+	std::unique_lock lock(m_Lock);
+
+	double took = std::chrono::duration<double>(finished - started).count();
+	double interval = bytes / m_Rate;
+
+	// Write outlived pacing interval, so data piles up faster than the printer takes it
+	if (took > interval) {
+		if(started >= m_LastDecrease)
+			Decrease(finished);
+		return;
+	}
+
+	if (took < interval / 2)
+		SetRate(m_Rate + IncreaseStep * bytes / std::max(m_Burst, std::size_t(1)));
+}
+
+void ShuiUploadPacing::OnWriteFailed() {
+	std::unique_lock lock(m_Lock);
+
+	Decrease(Clock::now());
+}
+
+void ShuiUploadPacing::Load() {
+	if(!std::filesystem::exists(m_Path))
+		return;
+
+	nlohmann::json json = nlohmann::json::parse(File::ReadEntire(m_Path), nullptr, false, false);
+
+	if (!json.is_object() || !json.contains("Rate") || !json["Rate"].is_number()) {
+		LogShuiUploadPacing(Error, "Can't read learned upload rate from %", m_Path.string());
+		return;
+	}
+
+	std::unique_lock lock(m_Lock);
+
+	SetRate(json["Rate"].get<double>());
+	m_SavedRate = m_Rate;
+
+	LogShuiUploadPacing(Display, "Starting uploads at learned rate of % B/s", m_SavedRate);
+}
+
+void ShuiUploadPacing::Save() {
+	std::unique_lock lock(m_Lock);
+
+	std::size_t rate = m_Rate;
+
+	if(rate == m_SavedRate)
+		return;
+
+	m_SavedRate = rate;
+
+	LogShuiUploadPacing(Display, "Learned upload rate of % B/s", rate);
+
+	Persistence::Write(m_Path, nlohmann::json{{"Rate", rate}}.dump());
+}
+
+void ShuiUploadPacing::SetRate(double rate) {
+	m_Rate = std::clamp(rate, double(MinRate), double(std::max(m_MaxRate, MinRate)));
+	m_Bucket.SetLimit(m_Rate, m_Burst);
+}
+
+void ShuiUploadPacing::Decrease(Clock::time_point now) {
+	SetRate(m_Rate * DecreaseFactor);
+	m_LastDecrease = now;
+}
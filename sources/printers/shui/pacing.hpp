@@ -0,0 +1,46 @@
+#pragma once
+
+#include "pch/std.hpp"
+#include "core/token_bucket.hpp"
+#include <mutex>
+
+// AIMD control of printer upload rate: grows additively while writes keep up and halves on stalls.
+// Learned rate is what the printer wifi module tolerated last time, so it is persisted
+class ShuiUploadPacing {
+public:
+	using Clock = TokenBucket::Clock;
+
+	static constexpr std::size_t MinRate = 8 * 1024; // 8KB/s
+private:
+	mutable std::mutex m_Lock;
+	std::filesystem::path m_Path;
+	TokenBucket m_Bucket;
+	std::size_t m_MaxRate = 0;
+	std::size_t m_Burst = 0;
+	double m_Rate = 0;
+	std::size_t m_SavedRate = 0;
+	// Writes started before the last decrease were slowed down by the same stall
+	Clock::time_point m_LastDecrease;
+public:
+	ShuiUploadPacing(const std::filesystem::path &path, std::size_t initial_rate, std::size_t max_rate, std::size_t burst);
+
+	TokenBucket &Bucket();
+
+	void SetLimit(std::size_t max_rate, std::size_t burst);
+
+	std::size_t Rate()const;
+
+	// Socket send buffer is kept small, so write duration follows what the printer actually accepts
+	void OnWriteCompleted(std::size_t bytes, Clock::time_point started, Clock::time_point finished);
+
+	void OnWriteFailed();
+
+	void Load();
+
+	// Does nothing unless the rate changed since last save
+	void Save();
+private:
+	void SetRate(double rate);
+
+	void Decrease(Clock::time_point now);
+};
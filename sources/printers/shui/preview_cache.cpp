@@ -0,0 +1,144 @@
+#include "preview_cache.hpp"
+#include <bsl/file.hpp>
+#include <bsl/log.hpp>
+#include "core/hash.hpp"
+#include "core/persistence.hpp"
+#include <charconv>
+
+DEFINE_LOG_CATEGORY(ShuiPreviewCache)
+
+// Bump when block layout changes, old blocks are then never hit again and age out
+static constexpr std::uint64_t FormatVersion = 1;
+static const char *BlockExtension = ".shui";
+
+ShuiPreviewCache::ShuiPreviewCache(const std::filesystem::path &path, std::size_t capacity):
+	m_Path(path),
+	m_Capacity(capacity)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(m_Path, ec);
+
+	LogShuiPreviewCacheIf((bool)ec, Error, "Can't create %: %", m_Path.string(), ec.message());
+
+	LoadBlocks();
+	Evict();
+}
+
+std::uint64_t ShuiPreviewCache::Key(std::string_view png) {
+	return ContentHasher::Hash(png, FormatVersion);
+}
+
+std::optional<std::string> ShuiPreviewCache::Find(std::uint64_t key) {
+	auto started = Clock::now();
+	std::filesystem::path path = PathFor(key);
+
+	std::error_code ec;
+	std::string block = std::filesystem::exists(path, ec) ? File::ReadEntire(path) : std::string();
+
+	std::unique_lock lock(m_Lock);
+
+	if (!block.size()) {
+		m_Misses++;
+		Forget(key);
+		return std::nullopt;
+	}
+
+	// Recently used blocks are the last to be evicted, write time keeps the order over restarts
+	std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+	Touch(key);
+
+	m_Hits++;
+
+	if (m_Misses) {
+		Clock::duration generation = m_GenerationTime / m_Misses;
+		m_SavedTime += std::max(generation - (Clock::now() - started), Clock::duration::zero());
+	}
+
+	LogStats();
+
+	return block;
+}
+
+void ShuiPreviewCache::Store(std::uint64_t key, const std::string &block, Clock::duration generation_time) {
+	// Same preview generated by two workers at once would be written through the same temp file
+	std::unique_lock lock(m_Lock);
+
+	if(Persistence::WriteNow(PathFor(key), block))
+		Touch(key);
+	else
+		LogShuiPreviewCache(Warning, "Can't store preview block %", key);
+
+	m_GenerationTime += generation_time;
+
+	LogStats();
+
+	Evict();
+}
+
+std::filesystem::path ShuiPreviewCache::PathFor(std::uint64_t key)const {
+	return m_Path / (std::to_string(key) + BlockExtension);
+}
+
+void ShuiPreviewCache::LoadBlocks() {
+	std::vector<std::pair<std::filesystem::file_time_type, std::uint64_t>> blocks;
+
+	std::error_code ec;
+	for (const auto &entry : std::filesystem::directory_iterator(m_Path, ec)) {
+		if(entry.path().extension() != BlockExtension)
+			continue;
+
+		std::string stem = entry.path().stem().string();
+		std::uint64_t key = 0;
+
+		auto [end, error] = std::from_chars(stem.data(), stem.data() + stem.size(), key);
+
+		if(error == std::errc() && end == stem.data() + stem.size())
+			blocks.emplace_back(entry.last_write_time(ec), key);
+	}
+
+	// Oldest first, so the most recent ends up in front
+	std::sort(blocks.begin(), blocks.end());
+
+	for(const auto &[_, key]: blocks)
+		Touch(key);
+}
+
+void ShuiPreviewCache::Touch(std::uint64_t key) {
+	auto it = m_BlockIndex.find(key);
+
+	if (it != m_BlockIndex.end()) {
+		m_Blocks.splice(m_Blocks.begin(), m_Blocks, it->second);
+		return;
+	}
+
+	m_Blocks.push_front(key);
+	m_BlockIndex.emplace(key, m_Blocks.begin());
+}
+
+void ShuiPreviewCache::Forget(std::uint64_t key) {
+	auto it = m_BlockIndex.find(key);
+
+	if(it == m_BlockIndex.end())
+		return;
+
+	m_Blocks.erase(it->second);
+	m_BlockIndex.erase(it);
+}
+
+void ShuiPreviewCache::Evict() {
+	std::error_code ec;
+
+	while (m_Blocks.size() > m_Capacity) {
+		std::uint64_t key = m_Blocks.back();
+
+		std::filesystem::remove(PathFor(key), ec);
+		Forget(key);
+	}
+}
+
+void ShuiPreviewCache::LogStats()const {
+	std::int64_t lookups = m_Hits + m_Misses;
+	auto saved = std::chrono::duration_cast<std::chrono::milliseconds>(m_SavedTime);
+
+	LogShuiPreviewCache(Display, "% hits of % lookups, % ms of preview generation saved", m_Hits, lookups, saved.count());
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "pch/std.hpp"
+#include <mutex>
+#include <chrono>
+#include <list>
+
+// Generated SHUI preview blocks on disk, keyed by the hash of the slicer thumbnail they were made from.
+// Reprinting a plate then skips decode, resize and encode altogether. Safe to use from worker threads
+class ShuiPreviewCache {
+public:
+	using Clock = std::chrono::steady_clock;
+private:
+	mutable std::mutex m_Lock;
+	std::filesystem::path m_Path;
+	std::size_t m_Capacity = 0;
+	// Keys of blocks on disk, most recently used first. Directory is only scanned once on start
+	std::list<std::uint64_t> m_Blocks;
+	std::unordered_map<std::uint64_t, std::list<std::uint64_t>::iterator> m_BlockIndex;
+	std::int64_t m_Hits = 0;
+	std::int64_t m_Misses = 0;
+	// Sum over misses, hits are credited with the average of it
+	Clock::duration m_GenerationTime = Clock::duration::zero();
+	Clock::duration m_SavedTime = Clock::duration::zero();
+public:
+	// Keeps at most capacity blocks, least recently used ones are removed first
+	ShuiPreviewCache(const std::filesystem::path &path, std::size_t capacity);
+
+	static std::uint64_t Key(std::string_view png);
+
+	std::optional<std::string> Find(std::uint64_t key);
+
+	// Generation time is what a later hit on this block is going to save
+	void Store(std::uint64_t key, const std::string &block, Clock::duration generation_time);
+private:
+	std::filesystem::path PathFor(std::uint64_t key)const;
+
+	void LoadBlocks();
+
+	void Touch(std::uint64_t key);
+
+	void Forget(std::uint64_t key);
+
+	void Evict();
+
+	void LogStats()const;
+};
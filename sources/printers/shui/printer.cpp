@@ -5,6 +5,7 @@
 #include <queue>
 #include <bsl/log.hpp>
 #include <bsl/defer.hpp>
+#include <bsl/parse.hpp>
 
 DEFINE_LOG_CATEGORY(Shui)
 
@@ -19,6 +20,16 @@ ShuiPrinter::ShuiPrinter(std::string ip, std::uint16_t port, const std::filesyst
     m_Storage(m_Ip, data_path / "storage"),
     m_History(data_path / "history.json", m_Storage)
 {
+	// History keeps showing metadata and previews of files long gone from the printer
+	std::unordered_set<std::uint64_t> printed;
+
+	for (const HistoryEntry &entry : m_History.GetHistory()) {
+		if(auto content_hash = FromString<std::uint64_t>(entry.FileId))
+			printed.insert(content_hash.value());
+	}
+
+	m_Storage.PruneCatalog(printed);
+
 	m_Connection = std::make_unique<ShuiPrinterConnection>(m_Ip, m_Port);
 	m_Connection->OnConnect = std::bind(&ShuiPrinter::OnConnectionConnect, this);
 	m_Connection->OnTick = std::bind(&ShuiPrinter::OnConnectionTick, this);
@@ -68,6 +79,8 @@ void ShuiPrinter::RunAsync(){
 void ShuiPrinter::HandleStateChanged(){
     m_History.OnStateChanged(m_State);
 
+    m_Storage.SetPrinterState(m_State.has_value(), m_State && m_State->Print && m_State->Print->Filename.size());
+
     std::call(OnStateChanged);
 }
 
@@ -159,6 +172,26 @@ PrinterStorage& ShuiPrinter::Storage(){
     return m_Storage;
 }
 
+void ShuiPrinter::SetUploadLimit(std::size_t max_rate, std::size_t burst){
+    m_Storage.SetUploadLimit(max_rate, burst);
+}
+
+void ShuiPrinter::SetUploadRetries(std::int32_t retries){
+    m_Storage.SetUploadRetries(retries);
+}
+
+void ShuiPrinter::SetGCodeCompaction(bool enabled){
+    m_Storage.SetGCodeCompaction(enabled);
+}
+
+void ShuiPrinter::SetArcFitting(double tolerance){
+    m_Storage.SetArcFitting(tolerance);
+}
+
+void ShuiPrinter::SetCutThroughUploads(bool enabled){
+    m_Storage.SetCutThroughUploads(enabled);
+}
+
 const PrinterHistory& ShuiPrinter::History() const{
     return m_History;
 }
@@ -211,11 +244,14 @@ void ShuiPrinter::OnConnectionPrinterLine(const std::string& line, std::int64_t
 
     SubmitReportSequenceAsync();
 
+    SubmitFileListAsync();
+
     UpdateStateFromSystemLine(line);
 }
 
 void ShuiPrinter::SubmitReportSequenceAsync() {
-    if(!m_Connection->GCodeDone())
+    // Background commands may still wait, reports go before them
+    if(!m_Connection->GCodeDone(GCodePriority::Normal))
         return;
 
     m_Connection->SubmitGCodeAsync("M27", [&](std::optional<std::string> result) {
@@ -262,6 +298,36 @@ void ShuiPrinter::SubmitReportSequenceAsync() {
     });
 }
 
+void ShuiPrinter::SubmitFileListAsync() {
+    static constexpr auto FileListInterval = std::chrono::seconds(60);
+
+    auto now = std::chrono::steady_clock::now();
+
+    if(now - m_LastFileListRequest < FileListInterval || !m_Storage.CanReconcile())
+        return;
+
+    m_LastFileListRequest = now;
+
+    // L asks for long names, firmware without them ignores it
+    m_Connection->SubmitGCodeAsync("M20 L", [this, generation = m_Storage.Generation()](std::optional<std::string> result) {
+        if(!result.has_value()){
+#if SHUI_VERBOSE_LOGGING
+            Println("\tM20 Failed");
+#endif
+            return;
+        }
+
+        auto files = ShuiPrinterStorage::ParseFileList(result.value());
+
+        if (!files.has_value()) {
+            LogShui(Warning, "M20: file list is incomplete, skipping reconciliation");
+            return;
+        }
+
+        m_Storage.Reconcile(files.value(), generation);
+    }, 0, GCodePriority::Low);
+}
+
 void ShuiPrinter::UpdateStateFromSystemLine(const std::string& line) {
     auto& state = State();
 
@@ -414,6 +480,8 @@ void ShuiPrinter::UpdateStateFromSdCardStatus(const std::string& line) {
         print.Progress = state.Percent;
         print.Layer = state.Layer;
         print.Height = state.Height;
+
+        changed |= UpdateRemainingTime(print, state);
     }
 
     if(changed) HandleStateChanged();
@@ -490,10 +558,37 @@ void ShuiPrinter::UpdateStateFromFeedRate(const std::string& line){
 
     if (State().FeedRate != feedrate){
         State().FeedRate = feedrate;
+
+        // Estimate is rescaled right away instead of waiting for the next progress report
+        if (State().Print.has_value()) {
+            auto &print = State().Print.value();
+
+            if(const GCodeFileRuntimeData *runtime = m_Storage.GetRuntimeData(print.Filename))
+                UpdateRemainingTime(print, runtime->GetStateNear(print.CurrentBytesPrinted));
+        }
+
         HandleStateChanged();
     }
 }
 
+bool ShuiPrinter::UpdateRemainingTime(PrintState& print, const GCodeRuntimeState& state)const{
+    std::optional<std::int64_t> remaining;
+
+    // Slicer estimates for 100% feed rate
+    if (state.RemainingMinutes >= 0) {
+        float feed_rate = m_State.has_value() ? m_State->FeedRate : 0.f;
+        float speed = feed_rate > 0 ? feed_rate / 100.f : 1.f;
+        remaining = std::llround(state.RemainingMinutes * 60 / speed);
+    }
+
+    if(print.RemainingSeconds == remaining)
+        return false;
+
+    print.RemainingSeconds = remaining;
+
+    return true;
+}
+
 std::optional<PrinterState> ShuiPrinter::GetPrinterState() const {
 	return m_State;
 }
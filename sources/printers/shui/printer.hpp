@@ -1,6 +1,7 @@
 #pragma once
 
 #include "pch/std.hpp"
+#include <chrono>
 #include "printers/state.hpp"
 #include "printers/shui/connection.hpp"
 #include "printers/shui/storage.hpp"
@@ -20,6 +21,8 @@ class ShuiPrinter: public Printer {
 	
 	ShuiPrinterStorage m_Storage;
 	ShuiPrinterHistory m_History;
+
+	std::chrono::steady_clock::time_point m_LastFileListRequest;
 public:
 	
 	ShuiPrinter(std::string ip, std::uint16_t port, const std::filesystem::path &data_path);
@@ -54,6 +57,16 @@ public:
 	
 	PrinterStorage &Storage()override;
 
+	void SetUploadLimit(std::size_t max_rate, std::size_t burst);
+
+	void SetUploadRetries(std::int32_t retries);
+
+	void SetGCodeCompaction(bool enabled);
+
+	void SetArcFitting(double tolerance);
+
+	void SetCutThroughUploads(bool enabled);
+
 	const PrinterHistory &History()const override;
 
 	bool IsConnected()const override;
@@ -72,6 +85,8 @@ public:
 
 	void SubmitReportSequenceAsync();
 
+	void SubmitFileListAsync();
+
 	void UpdateStateFromSystemLine(const std::string &line);
 
 	void UpdateStateFromSdCardStatus(const std::string &line);
@@ -80,6 +95,8 @@ public:
 
 	void UpdateStateFromFeedRate(const std::string &line);
 
+	bool UpdateRemainingTime(PrintState &print, const GCodeRuntimeState &state)const;
+
 	std::optional<PrinterState> GetPrinterState()const override;
 
 	bool TargetTemperaturesReached()const;
@@ -4,15 +4,18 @@
 #include "pch/json.hpp"
 
 struct GCodeRuntimeState {
+	// Kept 4 bytes wide so state packs into 16 bytes
 	float Percent = 0.f;
-	std::int64_t Layer = 0;
 	float Height = 0.f;
+	std::int32_t Layer = 0;
+	// Slicer estimate at 100% feed rate from M73 R, -1 if slicer doesn't emit it
+	std::int32_t RemainingMinutes = -1;
 	//std::int32_t FillamentIndex;
 
-	NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(GCodeRuntimeState, Percent, Layer, Height)
+	NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(GCodeRuntimeState, Percent, Layer, Height, RemainingMinutes)
 	
 	bool operator==(const GCodeRuntimeState& other)const{
-		return Percent == other.Percent && Layer == other.Layer && Height == other.Height;
+		return Percent == other.Percent && Layer == other.Layer && Height == other.Height && RemainingMinutes == other.RemainingMinutes;
 	}
 
 	bool operator!=(const GCodeRuntimeState& other)const{
@@ -20,14 +23,32 @@ struct GCodeRuntimeState {
 	}
 };
 
+// What content went through before it was indexed, offsets taken after one transform are meaningless for another
+struct GCodeTransform {
+	bool Compact = false;
+	// 0 when arcs aren't fitted
+	float ArcTolerance = 0.f;
+
+	NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(GCodeTransform, Compact, ArcTolerance)
+
+	bool operator==(const GCodeTransform& other)const{
+		return Compact == other.Compact && ArcTolerance == other.ArcTolerance;
+	}
+
+	bool operator!=(const GCodeTransform& other)const{
+		return !(*this == other);
+	}
+};
+
 struct GCodeFileRuntimeData {
 	std::vector<GCodeRuntimeState> States;
 	//Can't imagine file more that 4gigs
+	// Sorted, offset right after the line that switched to the matching state
 	std::vector<std::int32_t> Index;
 
 	NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(GCodeFileRuntimeData, States, Index)
 
 	GCodeRuntimeState GetStateNear(std::int64_t printed_byte)const;
 
-	static GCodeFileRuntimeData Parse(const std::string& content);
+	void ShiftIndex(std::int64_t bytes);
 };
@@ -4,6 +4,12 @@
 #include <unordered_set>
 #include <filesystem>
 #include "upload.hpp"
+#include "core/async.hpp"
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/bind_cancellation_slot.hpp>
+#include "core/hash.hpp"
+#include "compactor.hpp"
 #include <bsl/log.hpp>
 #include <bsl/parse.hpp>
 #include "pch/std.hpp"
@@ -15,20 +21,44 @@
 
 DEFINE_LOG_CATEGORY(ShuiStorage)
 
+static constexpr std::size_t PreviewCacheCapacity = 8 * 1024 * 1024;
+// About 110KB each
+static constexpr std::size_t ShuiPreviewCacheCapacity = 256;
+// Known to be safe, pacing starts here until it learns better
+static constexpr std::size_t DefaultUploadRate = 40 * 1024; //40KB/s
+static constexpr std::size_t DefaultMaxUploadRate = 256 * 1024;
+static constexpr std::size_t DefaultUploadBurst = 8 * 1024; // 8KB
+
 ShuiPrinterStorage::ShuiPrinterStorage(const std::string& ip, const std::filesystem::path &data_path):
     m_Ip(ip),
     m_OldPath(data_path),
-    m_FilesPath(data_path / "files"),
-    m_MetadataPath(data_path / "metadata")
+    m_Catalog(data_path),
+    m_PreviewCache(PreviewCacheCapacity, [](const Image &image) { return std::size_t(image.Width()) * image.Height() * sizeof(std::uint32_t); }),
+    m_UploadPacing(std::make_shared<ShuiUploadPacing>(data_path / "upload.json", DefaultUploadRate, DefaultMaxUploadRate, DefaultUploadBurst)),
+    m_ShuiPreviewCache(std::make_shared<ShuiPreviewCache>(data_path / "shui_previews", ShuiPreviewCacheCapacity))
 {
-    std::filesystem::create_directories(m_FilesPath);
-    std::filesystem::create_directories(m_MetadataPath);
+    std::filesystem::create_directories(data_path);
 
     Load();
 }
 
 std::optional<PrinterStorageUploadState> ShuiPrinterStorage::GetUploadState() const{
-    return m_UploadState;
+    std::optional<PrinterStorageUploadState> state = m_UploadState;
+
+    if (!state.has_value() && m_UploadQueue.size()) {
+        state = MakeUploadState(*m_UploadQueue.front());
+        state->Status = PrinterStorageUploadStatus::Queued;
+    }
+
+    if (!state.has_value())
+        return state;
+
+    for (const auto &job : m_UploadQueue) {
+        if(job->Id != state->Id)
+            state->Queue.push_back({job->Id, job->Filename, job->Force});
+    }
+
+    return state;
 }
 
 void ShuiPrinterStorage::Emit(std::optional<PrinterStorageUploadState> upload){
@@ -38,71 +68,447 @@ void ShuiPrinterStorage::Emit(std::optional<PrinterStorageUploadState> upload){
 
 static std::string NoError = "";
 
-void ShuiPrinterStorage::UploadGCodeFileAsync(const std::string& filename, const std::string& content, bool print, std::function<void(bool)> callback) {
-    Emit(PrinterStorageUploadState(filename));
+boost::asio::awaitable<bool> ShuiPrinterStorage::Upload(std::string filename, std::string content, bool print) {
+    co_return co_await UploadFrom(std::move(filename), std::move(content), print);
+}
+
+boost::asio::awaitable<bool> ShuiPrinterStorage::UploadSpooled(std::string filename, std::filesystem::path spool, bool print, std::function<void(std::uint64_t)> on_queued) {
+    co_return co_await UploadFrom(std::move(filename), std::move(spool), print, std::move(on_queued));
+}
 
-    auto OnProgressChanged = [this, filename](std::int64_t current, std::int64_t target) {
-        Emit(PrinterStorageUploadState(filename, current, target));
+boost::asio::awaitable<bool> ShuiPrinterStorage::UploadFrom(std::string filename, ShuiUploadSource source, bool print, std::function<void(std::uint64_t)> on_queued) {
+    auto Initiate = [this, &on_queued](auto handler, std::string filename, ShuiUploadSource source, bool print) {
+        auto slot = boost::asio::get_associated_cancellation_slot(handler);
+        auto shared_handler = std::make_shared<decltype(handler)>(std::move(handler));
+
+        // Posted, queued job completes right from CancelUpload, which may be running inside the slot handler
+        auto job = EnqueueUpload(filename, std::move(source), print, [slot, shared_handler](bool success)mutable {
+            boost::asio::post(Async::Context(), [slot, shared_handler, success]()mutable {
+                if(slot.is_connected())
+                    slot.clear();
+
+                (*shared_handler)(success);
+            });
+        });
+
+        if (slot.is_connected()) {
+            slot.assign([this, id = job->Id](boost::asio::cancellation_type) {
+                CancelUpload(id);
+            });
+        }
 
-        Println("%/%", current, target);
+        std::call(on_queued, job->Id);
+    };
+
+    co_return co_await boost::asio::async_initiate<const boost::asio::use_awaitable_t<>&, void(bool)>(Initiate, boost::asio::use_awaitable, std::move(filename), std::move(source), print);
+}
+
+void ShuiPrinterStorage::UploadGCodeFileAsync(const std::string& filename, std::string content, bool print, std::function<void(bool)> callback) {
+    auto OnCompleted = [callback = std::move(callback)](std::exception_ptr error, bool success) {
+        std::call(callback, !error && success);
+    };
+
+    boost::asio::co_spawn(Async::Context(), Upload(filename, std::move(content), print), std::move(OnCompleted));
+}
+
+std::shared_ptr<ShuiUploadJob> ShuiPrinterStorage::EnqueueUpload(const std::string& filename, ShuiUploadSource source_content, bool print, std::function<void(bool)> callback) {
+    auto job = std::make_shared<ShuiUploadJob>();
+    job->Id = ++m_LastUploadId;
+    job->Filename = filename;
+    job->Print = print;
+    job->Processed = std::make_shared<PreprocessedGCode>();
+    job->Callback = std::move(callback);
+
+    // Queued right away, so the order is the order uploads came in, not the order preprocessing finished
+    m_UploadQueue.push_back(job);
+    std::call(OnUploadStateChanged);
+
+    PreprocessAsync(job, std::move(source_content), true, [this, job]() {
+        job->Preprocessed = true;
+
+        PumpUploadQueue();
+    });
+
+    return job;
+}
+
+void ShuiPrinterStorage::PreprocessAsync(std::shared_ptr<ShuiUploadJob> job, ShuiUploadSource source_content, bool transform, std::function<void()> completion) {
+    std::filesystem::path spool = source_content.index() == 1 ? std::get<1>(source_content) : std::filesystem::path();
+    auto source = std::make_shared<std::string>(source_content.index() == 0 ? std::move(std::get<0>(source_content)) : std::string());
+    auto processed = job->Processed;
+
+    auto Hash = [source, spool, processed]() {
+        PROFILE_SCOPE(ShuiPrinterStorage, UploadGCodeFileAsync_Hash);
+        // Spool is streamed, so known content is recognized before anything is loaded
+        processed->ContentHash = spool.empty() ? ContentHasher::Hash(*source) : ContentHasher::HashFile(spool).value_or(0);
     };
 
-    auto OnUploaded = [this, callback = std::move(callback), filename = filename](std::variant<std::string, const std::string *> result) {
+    auto OnHashed = [this, job, source, spool, processed, transform, completion]() {
+        // Lookup has to happen on io thread, preprocessing then goes back to workers
+        GCodeTransform settings = transform ? GCodeTransform{m_CompactGCode, float(m_ArcTolerance)} : GCodeTransform();
+        auto known = std::make_shared<std::optional<GCodeAnalysis>>(FindAnalysis(processed->ContentHash, settings));
+
+        auto Preprocess = [this, source, spool, processed, known, preview_cache = m_ShuiPreviewCache, settings]() {
+            const GCodeAnalysis *analysis = known->has_value() ? &known->value() : nullptr;
+            // Thumbnail bytes only, previews of known content are rarely decoded, cached block is enough
+            std::optional<std::string> png = analysis && analysis->Metadata.Previews.size() ? ReadPreview(analysis->Metadata.Previews.back()) : std::nullopt;
+
+            if (!spool.empty()) {
+                PROFILE_SCOPE(ShuiPrinterStorage, UploadGCodeFileAsync_ReadSpool);
+
+                // Preprocessing rewrites the whole file and retries resend it, so it is loaded once here
+                *source = File::ReadEntire(spool);
+
+                std::error_code ec;
+                std::filesystem::remove(spool, ec);
+            }
+
+            *processed = PreprocessGCode(*source, processed->ContentHash, analysis, png.has_value() ? &png.value() : nullptr, preview_cache.get(), settings);
+            // Upload works with the processed copy only
+            *source = std::string();
+        };
+
+        auto OnPreprocessed = [job, completion]() {
+            LogSizeReduction(job->Filename, *job->Processed);
+
+            if(job->Processed->GCode.size())
+                job->Content = std::make_shared<const std::string>(std::move(job->Processed->GCode));
+
+            std::call(completion);
+        };
+
+        Async::Offload(Preprocess, OnPreprocessed);
+    };
+
+    Async::Offload(Hash, OnHashed);
+}
+
+std::optional<std::uint64_t> ShuiPrinterStorage::UploadStreamed(const std::string &filename, std::shared_ptr<GCodeUploadStream> stream, bool print, std::function<void(bool)> callback) {
+    // Pays off only when the printer link is free right away, queued uploads wait for the whole file anyway.
+    // Forwarded content goes out as is, so uploads are left to the queue whenever they'd be transformed
+    if(!m_CutThrough || m_CompactGCode || m_ArcTolerance > 0 || m_ActiveUpload || m_UploadQueue.size() || !m_Connected || m_Printing)
+        return std::nullopt;
+
+    auto job = std::make_shared<ShuiUploadJob>();
+    job->Id = ++m_LastUploadId;
+    job->Filename = filename;
+    job->Print = print;
+    job->Processed = std::make_shared<PreprocessedGCode>();
+    job->Stream = std::move(stream);
+    job->Callback = std::move(callback);
+
+    m_ActiveUpload = job;
+
+    LogShuiStorage(Display, "Forwarding '%' while it is received", filename);
+
+    Emit(MakeUploadState(*job));
 
-        const std::string &error = result.index() == 0 ? std::get<0>(result) : NoError;
-        const std::string *content = result.index() == 1 ? std::get<1>(result) : nullptr;
+    StreamedAttemptAsync(job);
 
-        if(content)
-            OnFileUploaded(filename, *content);
+    return job->Id;
+}
+
+// Spool of a forwarded upload may still be written when the upload is over
+static void RemoveWhenFinished(std::shared_ptr<GCodeUploadStream> stream) {
+    if (!stream->IsFinished()) {
+        stream->Wait([stream]() { RemoveWhenFinished(stream); });
+        return;
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(stream->Path(), ec);
+}
+
+void ShuiPrinterStorage::StreamedAttemptAsync(std::shared_ptr<ShuiUploadJob> job) {
+    // Slicers put thumbnails at the top, preview block has to be ready before anything goes out
+    static constexpr std::int64_t HeadSize = 1024 * 1024;
+
+    const auto &stream = job->Stream;
+
+    if (!job->Cancelled && !stream->IsFinished() && stream->Size() < HeadSize) {
+        stream->Wait([this, job]() { StreamedAttemptAsync(job); });
+        return;
+    }
+
+    if (job->Cancelled || stream->IsFailed()) {
+        OnStreamedAttemptFinished(job, job->Cancelled ? "Cancelled" : "Source upload was interrupted");
+        return;
+    }
+
+    auto prefix = std::make_shared<std::string>();
 
-        Println("Error [%], Filename: %, 8.3: %", error, filename, std::safe(Get83Filename(filename)));
+    auto MakePrefix = [prefix, path = stream->Path(), head_size = std::min(stream->Size(), HeadSize), preview_cache = m_ShuiPreviewCache]() {
+        PROFILE_SCOPE(ShuiPrinterStorage, StreamedAttemptAsync_Preview);
 
-        {
-            m_UploadState->Status = content ? PrinterStorageUploadStatus::Success : PrinterStorageUploadStatus::Failure;
-            std::call(OnUploadStateChanged);
-            Emit(std::nullopt);
+        std::string head(head_size, '\0');
+        std::ifstream file(path, std::ios::binary);
+
+        if(!file.read(head.data(), head.size()))
+            return;
+
+        // Whatever is cut at the end of the head is simply not complete, thumbnails come first
+        GCodeAnalysis analysis = GCodeAnalyzer::Analyze(head);
+
+        if(analysis.Previews.size())
+            *prefix = MakePreviewBlock(analysis.Previews.back(), preview_cache.get());
+    };
+
+    auto OnPrefix = [this, job, prefix]() {
+        if (job->Cancelled) {
+            OnStreamedAttemptFinished(job, "Cancelled");
+            return;
         }
 
-        std::call(callback, (bool)content);
+        job->StreamPrefix = prefix;
+
+        auto OnProgressChanged = [this, job](std::int64_t current, std::int64_t target) {
+            Emit(MakeUploadState(*job, current, target));
+        };
+
+        auto OnUploaded = [this, job](std::optional<std::string> error) {
+            OnStreamedAttemptFinished(job, error.value_or(NoError));
+        };
+
+        ShuiUpload::AsyncUploadStreamed(m_Ip, job->Filename, job->StreamPrefix, job->Stream, job->Print, OnProgressChanged, m_UploadPacing, boost::asio::bind_cancellation_slot(m_UploadCancel.slot(), OnUploaded));
     };
 
-    ShuiUpload::RunAsync(m_Ip, filename, PreprocessGCode(content), print, OnUploaded, OnProgressChanged);
+    Async::Offload(MakePrefix, OnPrefix);
+}
+
+void ShuiPrinterStorage::OnStreamedAttemptFinished(std::shared_ptr<ShuiUploadJob> job, const std::string &error) {
+    const auto &stream = job->Stream;
+
+    if ((job->Cancelled && error.size()) || stream->IsFailed()) {
+        // Nothing complete to send again
+        RemoveWhenFinished(stream);
+        job->Attempt = m_UploadAttempts;
+        OnUploadAttemptFinished(job, error.size() ? error : "Source upload was interrupted");
+        return;
+    }
+
+    // Analysis and retries both need the whole file
+    if (!stream->IsFinished()) {
+        stream->Wait([this, job, error]() { OnStreamedAttemptFinished(job, error); });
+        return;
+    }
+
+    bool sent = error.empty();
+
+    // Forwarded spool went out as is, while a retry is prepared like any queued upload
+    PreprocessAsync(job, stream->Path(), !sent, [this, job, error, sent]() {
+        if (sent && job->Content) {
+            // Index has to match the preview block that actually went out
+            std::int64_t shift = std::int64_t(job->StreamPrefix->size()) - job->Processed->PreviewSize;
+
+            job->Processed->Analysis.RuntimeData.ShiftIndex(shift);
+            job->Processed->Analysis.Metadata.BytesSize += shift;
+            job->Processed->PreviewSize = job->StreamPrefix->size();
+        }
+
+        if (!sent && !job->Content) {
+            job->Attempt = m_UploadAttempts;
+            OnUploadAttemptFinished(job, "Preprocessing failed");
+            return;
+        }
+
+        OnUploadAttemptFinished(job, error);
+    });
+}
+
+bool ShuiPrinterStorage::CancelUpload(std::uint64_t id) {
+    if (m_ActiveUpload && m_ActiveUpload->Id == id) {
+        if(m_ActiveUpload->Cancelled)
+            return false;
+
+        LogShuiStorage(Display, "Cancelling upload of '%' on attempt %", m_ActiveUpload->Filename, m_ActiveUpload->Attempt);
+
+        m_ActiveUpload->Cancelled = true;
+        // Completion still goes through OnUploadAttemptFinished, which sees the flag and doesn't retry
+        m_UploadCancel.emit(boost::asio::cancellation_type::terminal);
+        return true;
+    }
+
+    auto it = std::find_if(m_UploadQueue.begin(), m_UploadQueue.end(), [id](const auto &job) { return job->Id == id; });
+
+    if (it == m_UploadQueue.end())
+        return false;
+
+    auto job = *it;
+    m_UploadQueue.erase(it);
+
+    LogShuiStorage(Display, "Upload of '%' was cancelled while queued", job->Filename);
+
+    std::call(OnUploadStateChanged);
+    std::call(job->Callback, false);
+
+    PumpUploadQueue();
+
+    return true;
 }
 
-bool ShuiPrinterStorage::UploadGCodeFile(const std::string& filename, const std::string& content, bool print){
-    std::string processed_gcode = PreprocessGCode(content);
+bool ShuiPrinterStorage::ForceUpload(std::uint64_t id) {
+    auto it = std::find_if(m_UploadQueue.begin(), m_UploadQueue.end(), [id](const auto &job) { return job->Id == id; });
+
+    if (it == m_UploadQueue.end())
+        return false;
+
+    auto job = *it;
+    m_UploadQueue.erase(it);
+
+    job->Force = true;
+    m_UploadQueue.push_front(job);
+
+    std::call(OnUploadStateChanged);
+
+    PumpUploadQueue();
+
+    return true;
+}
+
+void ShuiPrinterStorage::SetPrinterState(bool connected, bool printing) {
+    if(m_Connected == connected && m_Printing == printing)
+        return;
+
+    m_Connected = connected;
+    m_Printing = printing;
+
+    PumpUploadQueue();
+}
+
+void ShuiPrinterStorage::PumpUploadQueue() {
+    if(m_ActiveUpload || !m_UploadQueue.size())
+        return;
+
+    auto job = m_UploadQueue.front();
+
+    // Strictly in order, later uploads wait for the first one to be preprocessed
+    if(!job->Preprocessed)
+        return;
+
+    // Unreachable printer would only use up the retries
+    if(!m_Connected)
+        return;
+
+    // Printer link is needed by the print itself, transfer would slow down or stall it
+    if(m_Printing && !job->Force)
+        return;
+
+    m_UploadQueue.pop_front();
+    m_ActiveUpload = job;
 
-    Emit(PrinterStorageUploadState(filename));
+    if (!job->Content) {
+        // Nothing to send, retrying wouldn't help
+        job->Attempt = m_UploadAttempts;
+        OnUploadAttemptFinished(job, "Preprocessing failed");
+        return;
+    }
+
+    UploadAttemptAsync(job);
+}
 
-    auto OnProgressChanged = [&](std::int64_t current, std::int64_t target) {
-        Emit(PrinterStorageUploadState(filename, current, target));
+void ShuiPrinterStorage::UploadAttemptAsync(std::shared_ptr<ShuiUploadJob> job) {
+    auto OnProgressChanged = [this, job](std::int64_t current, std::int64_t target) {
+        Emit(MakeUploadState(*job, current, target));
 
         Println("%/%", current, target);
     };
 
-    std::optional<std::string> result = ShuiUpload::Run(m_Ip, filename, processed_gcode, print, OnProgressChanged);
+    auto OnUploaded = [this, job](std::optional<std::string> error) {
+        OnUploadAttemptFinished(job, error.value_or(NoError));
+    };
+
+    Emit(MakeUploadState(*job));
+
+    ShuiUpload::AsyncUpload(m_Ip, job->Filename, job->Content, job->Print, OnProgressChanged, m_UploadPacing, boost::asio::bind_cancellation_slot(m_UploadCancel.slot(), OnUploaded));
+}
+
+void ShuiPrinterStorage::OnUploadAttemptFinished(std::shared_ptr<ShuiUploadJob> job, const std::string &error) {
+    static constexpr auto FirstRetryDelay = std::chrono::seconds(2);
+    static constexpr auto MaxRetryDelay = std::chrono::seconds(60);
+
+    bool success = error.empty();
+
+    m_UploadPacing->Save();
+
+    if (!success && !job->Cancelled && job->Attempt < m_UploadAttempts) {
+        // Printer accepts whole files only, so the retry sends everything again, but from the already processed content
+        auto delay = std::min<std::chrono::seconds>(FirstRetryDelay * (1 << std::min(job->Attempt - 1, 5)), MaxRetryDelay);
+
+        LogShuiStorage(Warning, "Upload of '%' failed on attempt %/%: %, retrying in %s", job->Filename, job->Attempt, m_UploadAttempts, error, delay.count());
 
-    bool success = !result.has_value();
+        job->LastError = error;
+
+        PrinterStorageUploadState state = MakeUploadState(*job, m_UploadState ? m_UploadState->Current : 0, m_UploadState ? m_UploadState->Target : 0);
+        state.Status = PrinterStorageUploadStatus::Retrying;
+        Emit(state);
+
+        auto timer = std::make_shared<boost::asio::steady_timer>(Async::Context(), delay);
+
+        auto OnRetryDelay = [this, job, timer](const boost::system::error_code &ec) {
+            if (ec) {
+                OnUploadAttemptFinished(job, "Cancelled");
+                return;
+            }
+
+            job->Attempt++;
+            UploadAttemptAsync(job);
+        };
+
+        timer->async_wait(boost::asio::bind_cancellation_slot(m_UploadCancel.slot(), OnRetryDelay));
+        return;
+    }
 
     if(success)
-        OnFileUploaded(filename, processed_gcode);
-    
+        OnFileUploaded(job->Filename, std::move(*job->Processed));
+
+    Println("Error [%], Filename: %, 8.3: %", error, job->Filename, std::safe(Get83Filename(job->Filename)));
+
     {
+        if(!m_UploadState)
+            m_UploadState = MakeUploadState(*job);
+
         m_UploadState->Status = success ? PrinterStorageUploadStatus::Success : PrinterStorageUploadStatus::Failure;
+        m_UploadState->Error = error;
         std::call(OnUploadStateChanged);
+        m_ActiveUpload = nullptr;
         Emit(std::nullopt);
     }
-    
-    if(result.has_value())
-        LogShuiStorage(Error, "UploadGCode exited with error '%'", result.value());
 
-    Println("Error [%], Filename: %, 8.3: %", result.value_or(""), filename, std::safe(Get83Filename(filename)));
+    std::call(job->Callback, success);
 
-    return success;
+    PumpUploadQueue();
 }
 
+PrinterStorageUploadState ShuiPrinterStorage::MakeUploadState(const ShuiUploadJob &job, std::int32_t current, std::int32_t target)const {
+    PrinterStorageUploadState state(job.Filename, current, target);
+    state.Id = job.Id;
+    state.Attempt = job.Attempt;
+    state.MaxAttempts = m_UploadAttempts;
+    state.Error = job.LastError;
+    return state;
+}
+
+void ShuiPrinterStorage::SetUploadLimit(std::size_t max_rate, std::size_t burst){
+    m_UploadPacing->SetLimit(max_rate, burst);
+}
+
+void ShuiPrinterStorage::SetUploadRetries(std::int32_t retries){
+    m_UploadAttempts = std::max(retries, 0) + 1;
+}
+
+void ShuiPrinterStorage::SetGCodeCompaction(bool enabled){
+    m_CompactGCode = enabled;
+}
+
+void ShuiPrinterStorage::SetArcFitting(double tolerance){
+    m_ArcTolerance = std::max(tolerance, 0.0);
+}
 
-const GCodeFileMetadata* ShuiPrinterStorage::GetMetadata(std::size_t content_hash) const{
+void ShuiPrinterStorage::SetCutThroughUploads(bool enabled){
+    m_CutThrough = enabled;
+}
+
+const GCodeFileMetadata* ShuiPrinterStorage::GetMetadata(std::uint64_t content_hash) const{
     if(!m_ContentHashToMetadata.count(content_hash))
         return nullptr;
 
@@ -118,7 +524,7 @@ const GCodeFileMetadata* ShuiPrinterStorage::GetMetadata(const std::string& long
     return GetMetadata(*hash);
 }
 
-std::optional<std::size_t> ShuiPrinterStorage::GetContentHashFor83Filename(const std::string& _83_filename) const{
+std::optional<std::uint64_t> ShuiPrinterStorage::GetContentHashFor83Filename(const std::string& _83_filename) const{
     if(!m_83ToFile.count(_83_filename))
         return std::nullopt;
     const auto &file = m_83ToFile.at(_83_filename);
@@ -126,7 +532,47 @@ std::optional<std::size_t> ShuiPrinterStorage::GetContentHashFor83Filename(const
     return file.ContentHash;
 }
 
-std::optional<std::size_t> ShuiPrinterStorage::GetContentHashForFilename(const std::string& filename) const{
+std::optional<std::string> ShuiPrinterStorage::ReadPreview(const GCodePreviewRef& preview) const{
+    return m_Catalog.ReadPreview(preview);
+}
+
+std::shared_ptr<const Image> ShuiPrinterStorage::GetPreviewImage(const GCodeFileMetadata& metadata) const{
+    if(!metadata.Previews.size())
+        return nullptr;
+
+    // biggest one
+    const GCodePreviewRef &preview = metadata.Previews.back();
+
+    {
+        std::lock_guard<std::mutex> lock(m_PreviewCacheLock);
+
+        if(auto image = m_PreviewCache.Find(preview.Offset))
+            return image;
+    }
+
+    PROFILE_SCOPE(ShuiPrinterStorage, GetPreviewImage_Decode);
+
+    std::optional<std::string> png = m_Catalog.ReadPreview(preview);
+
+    if(!png.has_value())
+        return nullptr;
+
+    std::optional<Image> image = Image::LoadFromMemory(png->data(), png->size());
+
+    if(!image.has_value())
+        return nullptr;
+
+    auto result = std::make_shared<const Image>(std::move(image.value()));
+
+    std::lock_guard<std::mutex> lock(m_PreviewCacheLock);
+    m_PreviewCache.Put(preview.Offset, result);
+
+    LogShuiStorage(Verbose, "Preview cache: % hits, % misses, %/% bytes", m_PreviewCache.Hits(), m_PreviewCache.Misses(), m_PreviewCache.Size(), m_PreviewCache.Capacity());
+
+    return result;
+}
+
+std::optional<std::uint64_t> ShuiPrinterStorage::GetContentHashForFilename(const std::string& filename) const{
     const std::string *_83 = Get83Filename(filename);
 
     if(!_83)
@@ -135,22 +581,146 @@ std::optional<std::size_t> ShuiPrinterStorage::GetContentHashForFilename(const s
     return GetContentHashFor83Filename(*_83);
 }
 
-std::string ShuiPrinterStorage::PreprocessGCode(const std::string &content) {
+PreprocessedGCode ShuiPrinterStorage::PreprocessGCode(const std::string &content, std::uint64_t content_hash, const GCodeAnalysis *known_analysis, const std::string *known_preview_png, ShuiPreviewCache *preview_cache, const GCodeTransform &transform) {
+    PROFILE_SCOPE(ShuiPrinterStorage, PreprocessGCode);
+
+    PreprocessedGCode result;
+    result.ContentHash = content_hash;
+    result.SourceSize = content.size();
+    result.Transform = transform;
+
+    bool fit_arcs = transform.ArcTolerance > 0;
+
+    // Transforms feed it as they go, metadata and previews come from lines they read, since compaction
+    // strips the comments those live in, and the index from lines they write, since printer reports offsets into what it got
+    GCodeAnalyzer analyzer;
+    GCodeAnalyzer *collect = known_analysis ? nullptr : &analyzer;
+
+    std::string transformed;
+    std::string_view body = content;
+
+    if (transform.Compact) {
+        PROFILE_SCOPE(ShuiPrinterStorage, PreprocessGCode_Compact);
+
+        transformed = GCodeCompactor::Compact(body, collect, fit_arcs ? nullptr : collect);
+        body = transformed;
+    }
+
+    if (fit_arcs) {
+        PROFILE_SCOPE(ShuiPrinterStorage, PreprocessGCode_FitArcs);
+
+        transformed = GCodeArcFitter::Fit(body, transform.ArcTolerance, &result.ArcFit, transform.Compact ? nullptr : collect, collect);
+        body = transformed;
+    }
+
+    if (known_analysis) {
+        result.Analysis = *known_analysis;
+    } else if (body.data() != content.data()) {
+        result.Analysis = analyzer.Finish();
+    } else {
+        PROFILE_SCOPE(ShuiPrinterStorage, PreprocessGCode_Analyze);
+        result.Analysis = GCodeAnalyzer::Analyze(content);
+    }
+
+    result.Analysis.Metadata.BytesSize = body.size();
+
+    const std::vector<std::string> &previews = result.Analysis.Previews;
+
+    // biggest one
+    std::string_view png = previews.size() ? std::string_view(previews.back()) : known_preview_png ? std::string_view(*known_preview_png) : std::string_view();
+
+    result.GCode = MakePreviewBlock(png, preview_cache, &result.Preview);
+
+    // Analysis offsets are for the content alone, the printer sees it after the preview
+    result.PreviewSize = result.GCode.size();
+    result.Analysis.RuntimeData.ShiftIndex(result.PreviewSize);
+    result.Analysis.Metadata.BytesSize += result.PreviewSize;
+
+    result.GCode += body;
+    result.CompactedSize = body.size();
+
+    return result;
+}
+
+std::string ShuiPrinterStorage::MakePreviewBlock(std::string_view png, ShuiPreviewCache *preview_cache, std::shared_ptr<const Image> *decoded) {
     static std::string ShuiPreviewStart50 = ";SHUI PREVIEW 50x50\n";
     static std::string ShuiPreviewStart100 = ";SHUI PREVIEW 100x100\n";
     static std::string ShuiPreviewEnd = ";End of SHUI PREVIEW\n";
 
-    std::vector<Image> previews = GCodeFileMetadata::GetPreviews(content);
-    
-    if(!previews.size())
-        return content;
-    
-    // biggest one
-    Image &base = previews.back();
+    if(!png.size())
+        return {};
+
+    std::optional<std::uint64_t> preview_key;
+
+    if (preview_cache) {
+        preview_key = ShuiPreviewCache::Key(png);
+
+        if(std::optional<std::string> block = preview_cache->Find(preview_key.value()))
+            return std::move(block.value());
+    }
+
+    auto started = ShuiPreviewCache::Clock::now();
+
+    std::shared_ptr<const Image> preview;
+
+    {
+        PROFILE_SCOPE(ShuiPrinterStorage, PreprocessGCode_Decode);
+
+        if(std::optional<Image> image = Image::LoadFromMemory(png.data(), png.size()))
+            preview = std::make_shared<const Image>(std::move(image.value()));
+    }
+
+    if(!preview)
+        return {};
+
+    std::string block;
+
+    {
+        PROFILE_SCOPE(ShuiPrinterStorage, PreprocessGCode_Preview);
+
+        block = ShuiPreviewStart50 + preview->Resize(50,50).ToSHUI() 
+            + preview->Resize(200, 200).ToSHUI() + ShuiPreviewEnd;
+    }
+
+    if(preview_key.has_value())
+        preview_cache->Store(preview_key.value(), block, ShuiPreviewCache::Clock::now() - started);
+
+    if(decoded)
+        *decoded = std::move(preview);
+
+    return block;
+}
+
+void ShuiPrinterStorage::LogSizeReduction(const std::string &filename, const PreprocessedGCode &processed) {
+    if(!processed.GCode.size() || processed.CompactedSize == processed.SourceSize)
+        return;
+
+    std::int64_t saved = processed.SourceSize - processed.CompactedSize;
+
+    LogShuiStorage(Display, "Compacted '%' from % to % bytes, % bytes less to send", filename, processed.SourceSize, processed.CompactedSize, saved);
+
+    LogShuiStorageIf(processed.ArcFit.Arcs, Display, "Merged % moves of '%' into % arcs", processed.ArcFit.MergedSegments, filename, processed.ArcFit.Arcs);
+}
+
+std::optional<GCodeAnalysis> ShuiPrinterStorage::FindAnalysis(std::uint64_t content_hash, const GCodeTransform &transform) const{
+    const GCodeFileMetadata *metadata = GetMetadata(content_hash);
+
+    if(!metadata)
+        return std::nullopt;
+
+    for (const auto &[_83, entry] : m_83ToFile) {
+        if(entry.ContentHash != content_hash || entry.HashVersion != ContentHasher::Version || entry.Transform != transform)
+            continue;
 
-    return ShuiPreviewStart50 + base.Resize(50,50).ToSHUI() 
-        + base.Resize(200, 200).ToSHUI() + ShuiPreviewEnd 
-        + content;
+        LogShuiStorage(Display, "Content % is already known as '%', skipping analysis", content_hash, entry.LongFilename);
+
+        GCodeAnalysis analysis{*metadata, entry.RuntimeData};
+        analysis.RuntimeData.ShiftIndex(-entry.PreviewSize);
+
+        return analysis;
+    }
+
+    return std::nullopt;
 }
 
 const GCodeFileRuntimeData* ShuiPrinterStorage::GetRuntimeData(const std::string& long_filename) const{
@@ -159,29 +729,31 @@ const GCodeFileRuntimeData* ShuiPrinterStorage::GetRuntimeData(const std::string
     if(!_83)
         return nullptr;
     
-    if(!m_83ToFile.count(*_83))
-        return nullptr;
+    auto it = m_83ToFile.find(*_83);
 
-    const GCodeFileEntry& file = m_83ToFile.at(*_83);
+    if(it == m_83ToFile.end())
+        return nullptr;
 
-    return &file.RuntimeData;
+    return &it->second.RuntimeData;
 }
 
 const std::string* ShuiPrinterStorage::GetLongFilename(const std::string& _83_name)const {
 	auto it = m_83ToFile.find(_83_name);
 
-	if(it == m_83ToFile.end())
+	// Files put on the printer some other way have no long name
+	if(it == m_83ToFile.end() || it->second.IsPrinterNative())
 		return nullptr;
 
 	return &it->second.LongFilename;
 }
 
 const std::string* ShuiPrinterStorage::Get83Filename(const std::string& long_filename) const {
-    for (const auto& [_83, file] : m_83ToFile) {
-        if(file.LongFilename == long_filename)
-            return &_83;
-    }
-    return nullptr;
+    auto it = m_LongTo83.find(long_filename);
+
+    if(it == m_LongTo83.end())
+        return nullptr;
+
+    return &it->second;
 }
 
 bool ShuiPrinterStorage::ExistsLong(const std::string& long_filename) const{
@@ -189,7 +761,7 @@ bool ShuiPrinterStorage::ExistsLong(const std::string& long_filename) const{
 }
 
 bool ShuiPrinterStorage::Exists83(const std::string& _83_filename) const{
-    return GetLongFilename(_83_filename);
+    return m_83ToFile.count(_83_filename);
 }
 
 std::vector<std::string> ShuiPrinterStorage::GetStoredFiles83() const{
@@ -273,7 +845,7 @@ std::string ShuiPrinterStorage::ConvertTo83Revisioned(const std::string& long_fi
     return base + revision_prefix + extension;
 }
 
-bool ShuiPrinterStorage::OnFileUploaded(const std::string& filename, const std::string& content){
+bool ShuiPrinterStorage::OnFileUploaded(const std::string& filename, PreprocessedGCode &&gcode){
     PROFILE_SCOPE(ShuiPrinterStorage, OnFileUploaded);
     
     if(!ExistsLong(filename)){
@@ -286,7 +858,7 @@ bool ShuiPrinterStorage::OnFileUploaded(const std::string& filename, const std::
         
         GCodeFileEntry entry;
         entry.LongFilename = filename;
-        m_83ToFile.emplace(_83, std::move(entry));
+        AddEntry(_83, std::move(entry));
     }
     
     const std::string* _83_ptr = Get83Filename(filename);
@@ -299,95 +871,361 @@ bool ShuiPrinterStorage::OnFileUploaded(const std::string& filename, const std::
     std::string _83 = *_83_ptr;
 
     GCodeFileEntry& entry = m_83ToFile.at(_83);
-    
-    {
-        PROFILE_SCOPE(ShuiPrinterStorage, OnFileUploaded_Hash);
-        entry.ContentHash = std::hash<std::string>()(content);
-    } 
 
-    {
-        PROFILE_SCOPE(ShuiPrinterStorage, OnFileUploaded_ParseRuntimeData);
-        entry.RuntimeData = GCodeFileRuntimeData::Parse(content);
-    }
+    m_Generation++;
     
-    {
-        PROFILE_SCOPE(ShuiPrinterStorage, OnFileUploaded_ParseFileMetadata);
-        m_ContentHashToMetadata[entry.ContentHash] = GCodeFileMetadata::ParseFromGCode(content);
+    entry.ContentHash = gcode.ContentHash;
+    entry.HashVersion = ContentHasher::Version;
+    entry.RuntimeData = std::move(gcode.Analysis.RuntimeData);
+    entry.Transform = gcode.Transform;
+    entry.PreviewSize = gcode.PreviewSize;
+
+    std::uint64_t content_hash = entry.ContentHash;
+
+    // Same content, previews are already stored
+    if (m_ContentHashToMetadata.count(content_hash) || !gcode.Analysis.Previews.size()) {
+        m_ContentHashToMetadata.try_emplace(content_hash, std::move(gcode.Analysis.Metadata));
+        SaveCatalog();
+        return true;
     }
+    
+    m_ContentHashToMetadata[content_hash] = std::move(gcode.Analysis.Metadata);
 
-    {
-        PROFILE_SCOPE(ShuiPrinterStorage, OnFileUploaded_SaveToFileMetadata);
-        Save(m_ContentHashToMetadata[entry.ContentHash], entry.ContentHash);
-    }
+    auto pngs = std::make_shared<std::vector<std::string>>(std::move(gcode.Analysis.Previews));
+    auto previews = std::make_shared<std::vector<GCodePreviewRef>>();
 
-    {
-        PROFILE_SCOPE(ShuiPrinterStorage, OnFileUploaded_SaveToFileEntry);
-        Save(entry, _83);
-    }
+    auto AppendPreviews = [this, pngs, previews]() {
+        PROFILE_SCOPE(ShuiPrinterStorage, OnFileUploaded_AppendPreviews);
+
+        for (const std::string &png : *pngs) {
+            if(auto preview = m_Catalog.AppendPreview(png))
+                previews->push_back(preview.value());
+        }
+    };
+
+    auto OnPreviewsAppended = [this, content_hash, pngs, previews, image = std::move(gcode.Preview)]() {
+        // Decoded image is only known to be the biggest one if nothing was lost
+        if (image && previews->size() && previews->size() == pngs->size()) {
+            std::lock_guard<std::mutex> lock(m_PreviewCacheLock);
+            m_PreviewCache.Put(previews->back().Offset, image);
+        }
+
+        auto it = m_ContentHashToMetadata.find(content_hash);
+
+        if(it != m_ContentHashToMetadata.end())
+            it->second.Previews = std::move(*previews);
+
+        SaveCatalog();
+    };
+
+    Async::Offload(AppendPreviews, OnPreviewsAppended);
 
     return true;
 }
 
-std::optional<GCodeFileEntry> GCodeFileEntry::LoadFromFile(std::filesystem::path filepath) {
-    try{
-        GCodeFileEntry entry = nlohmann::json::parse(File::ReadEntire(filepath), nullptr, false, false);
-        
-        return entry;
-    }catch (...) {
-        return std::nullopt;
-    }
-}
+GCodeFileEntry& ShuiPrinterStorage::AddEntry(const std::string& _83, GCodeFileEntry&& entry) {
+    auto [it, inserted] = m_83ToFile.emplace(_83, std::move(entry));
+
+    if(inserted && !it->second.IsPrinterNative() && !m_LongTo83.emplace(it->second.LongFilename, _83).second)
+        LogShuiStorage(Warning, "Long filename '%' is already mapped to '%', ignoring '%'", it->second.LongFilename, m_LongTo83.at(it->second.LongFilename), _83);
 
-void GCodeFileEntry::SaveToFile(const std::filesystem::path& filepath)const{
-    File::WriteEntire(filepath, nlohmann::json(*this).dump());
+    return it->second;
 }
 
-void ShuiPrinterStorage::Save(const GCodeFileEntry& entry, const std::string& _83)const {
-    auto entry_path = m_FilesPath / _83;
+void ShuiPrinterStorage::RemoveEntry(const std::string& _83) {
+    auto it = m_83ToFile.find(_83);
 
-    std::filesystem::create_directories(m_FilesPath);
-    
-    entry.SaveToFile(entry_path);
+    if(it == m_83ToFile.end())
+        return;
+
+    auto long_it = it->second.IsPrinterNative() ? m_LongTo83.end() : m_LongTo83.find(it->second.LongFilename);
+
+    if(long_it != m_LongTo83.end() && long_it->second == _83)
+        m_LongTo83.erase(long_it);
+
+    m_83ToFile.erase(it);
 }
 
-void ShuiPrinterStorage::Save(const GCodeFileMetadata& entry, std::size_t content_hash) const{
-    auto metadata_path = m_MetadataPath / ToString(content_hash);
+std::uint64_t ShuiPrinterStorage::Generation() const{
+    return m_Generation;
+}
 
-    std::filesystem::create_directories(m_MetadataPath);
-    
-    File::WriteEntire(metadata_path, nlohmann::json(entry).dump());
+bool ShuiPrinterStorage::CanReconcile() const{
+    return !m_UploadState.has_value();
 }
 
-void ShuiPrinterStorage::Load() {
-    for (auto file_entry: std::filesystem::directory_iterator(m_FilesPath)) {
-        if(!file_entry.is_regular_file())
+void ShuiPrinterStorage::Reconcile(const std::vector<ShuiListedFile>& listed, std::uint64_t generation) {
+    PROFILE_SCOPE(ShuiPrinterStorage, Reconcile);
+
+    if (generation != m_Generation || !CanReconcile()) {
+        LogShuiStorage(Display, "Storage changed while listing printer files, skipping reconciliation");
+        return;
+    }
+
+    std::unordered_map<std::string, const ShuiListedFile*> by_83;
+    std::unordered_map<std::string, const ShuiListedFile*> by_long;
+
+    for (const ShuiListedFile &file : listed) {
+        by_83.emplace(file.Filename83, &file);
+
+        if(file.LongFilename.size())
+            by_long.emplace(file.LongFilename, &file);
+    }
+
+    // Firmware may list long names in place of 8.3 ones, those come uppercased like any other
+    auto FindListed = [&](const std::string &_83, const GCodeFileEntry &entry) -> const ShuiListedFile* {
+        if(auto it = by_83.find(_83); it != by_83.end())
+            return it->second;
+
+        if(entry.IsPrinterNative())
+            return nullptr;
+
+        if(auto it = by_long.find(entry.LongFilename); it != by_long.end())
+            return it->second;
+
+        std::string long_upper = entry.LongFilename;
+        std::transform(long_upper.begin(), long_upper.end(), long_upper.begin(), ::toupper);
+
+        auto it = by_83.find(long_upper);
+        return it != by_83.end() ? it->second : nullptr;
+    };
+
+    std::unordered_set<const ShuiListedFile*> matched;
+    std::vector<std::string> removed;
+    std::unordered_set<std::string> missing;
+    // Guessed 8.3 name to the one firmware actually gave the file
+    std::vector<std::pair<std::string, std::string>> renamed;
+
+    // Card remount or a cut reply can hide files once, so only a second listing in a row without them counts
+    for (const auto &[_83, entry] : m_83ToFile) {
+        if (const ShuiListedFile *file = FindListed(_83, entry)) {
+            matched.insert(file);
+
+            if(file->Filename83 != _83 && file->LongFilename == entry.LongFilename && !m_83ToFile.count(file->Filename83))
+                renamed.emplace_back(_83, file->Filename83);
             continue;
+        }
 
-        std::string _83 = file_entry.path().filename().string();
+        if(m_MissingOnPrinter.count(_83))
+            removed.push_back(_83);
+        else
+            missing.insert(_83);
+    }
+
+    // Listing naming files in a way nothing here matches says more about the listing than about the files
+    if (m_83ToFile.size() && matched.empty()) {
+        LogShuiStorage(Warning, "None of % known files is in printer listing of % files, skipping reconciliation", m_83ToFile.size(), listed.size());
+        return;
+    }
 
-        auto entry = GCodeFileEntry::LoadFromFile(file_entry.path());
+    m_MissingOnPrinter = std::move(missing);
+
+    for(const auto &_83: removed)
+        RemoveEntry(_83);
+
+    for (const auto &[guessed, actual] : renamed) {
+        GCodeFileEntry entry = std::move(m_83ToFile.at(guessed));
+        RemoveEntry(guessed);
+        AddEntry(actual, std::move(entry));
+    }
 
-        if(!entry.has_value())
+    std::int64_t added = 0;
+
+    for (const ShuiListedFile &file : listed) {
+        if(matched.count(&file) || m_83ToFile.count(file.Filename83))
             continue;
-        
-        m_83ToFile.emplace(_83, std::move(entry.value()));
+
+        // Not uploaded through proxy, real content is unknown. Tracked anyway so 8.3 names never collide
+        AddEntry(file.Filename83, GCodeFileEntry());
+        added++;
     }
 
-    for (auto file_entry: std::filesystem::directory_iterator(m_MetadataPath)) {
-        if(!file_entry.is_regular_file())
+    if(!removed.size() && !renamed.size() && !added)
+        return;
+
+    LogShuiStorage(Display, "Reconciled with printer files, % added, % removed, % renamed, % missing once", added, removed.size(), renamed.size(), m_MissingOnPrinter.size());
+
+    SaveCatalog();
+}
+
+std::optional<std::vector<ShuiListedFile>> ShuiPrinterStorage::ParseFileList(const std::string& m20_result) {
+    static constexpr std::string_view BeginFileList = "Begin file list";
+    static constexpr std::string_view EndFileList = "End file list";
+
+    std::vector<ShuiListedFile> result;
+    bool begun = false;
+
+    StringStream stream(m20_result);
+
+    while (auto line = stream.GetLine()) {
+        std::string_view file = line.value();
+
+        if(file.size() && file.back() == '\r')
+            file.remove_suffix(1);
+
+        if (file.starts_with(BeginFileList)) {
+            begun = true;
+            result.clear();
             continue;
+        }
 
-        auto hash = FromString<std::size_t>(file_entry.path().filename().string());
+        if (file.starts_with(EndFileList)) {
+            if(!begun)
+                return std::nullopt;
+            return result;
+        }
 
-        if(!hash.has_value())
+        if(!begun || !file.size())
             continue;
 
-        auto data = GCodeFileMetadata::ParseFromJsonFile(file_entry.path());
+        // NAME.GCO <size> <long name>, long name only when asked for with M20 L and firmware supports it
+        std::string_view long_name;
+
+        if (std::size_t space = file.find(' '); space != std::string_view::npos) {
+            long_name = file.substr(space + 1);
+            file = file.substr(0, space);
+        }
 
-        if(!data.has_value())
+        if(std::size_t size_end = long_name.find_first_not_of("0123456789"); size_end != 0)
+            long_name = size_end != std::string_view::npos && long_name[size_end] == ' ' ? long_name.substr(size_end + 1) : std::string_view();
+
+        if(file.starts_with('/'))
+            file.remove_prefix(1);
+
+        // Storage only tracks root
+        if(!file.size() || file.find('/') != std::string_view::npos)
             continue;
-        
-        m_ContentHashToMetadata.emplace(hash.value(), std::move(data.value()));
+
+        std::string _83(file);
+        std::transform(_83.begin(), _83.end(), _83.begin(), ::toupper);
+        result.push_back({std::move(_83), std::string(long_name)});
     }
+
+    return std::nullopt;
 }
 
+void ShuiPrinterStorage::PruneCatalog(const std::unordered_set<std::uint64_t> &retained) {
+    PROFILE_SCOPE(ShuiPrinterStorage, PruneCatalog);
+
+    std::unordered_set<std::uint64_t> referenced = retained;
+
+    for(const auto &[_83, entry]: m_83ToFile)
+        referenced.insert(entry.ContentHash);
+
+    std::size_t dropped = std::erase_if(m_ContentHashToMetadata, [&referenced](const auto &pair) {
+        return !referenced.count(pair.first);
+    });
+
+    LogShuiStorageIf(dropped, Display, "Dropped metadata of % files nothing refers to anymore", dropped);
+
+    if(!m_Catalog.CompactPreviews(m_83ToFile, m_ContentHashToMetadata) && dropped)
+        SaveCatalog();
+}
+
+void ShuiPrinterStorage::SaveCatalog() {
+    m_Catalog.Write(m_Catalog.Serialize(m_83ToFile, m_ContentHashToMetadata));
+}
+
+void ShuiPrinterStorage::Load() {
+    PROFILE_SCOPE(ShuiPrinterStorage, Load);
+
+    bool migrating = !m_Catalog.Exists();
+
+    std::optional<ShuiCatalogContent> content = migrating ? ReadLegacyFiles() : m_Catalog.Read();
+
+    if (!content.has_value()) {
+        if(!migrating)
+            m_Catalog.Discard();
+        return;
+    }
+
+    std::int64_t legacy_entries = 0;
+
+    for (auto &[_83, entry] : content->Files) {
+        if(entry.HashVersion != ContentHasher::Version)
+            legacy_entries++;
+
+        AddEntry(_83, std::move(entry));
+    }
+
+    for(auto &[content_hash, metadata]: content->Metadata)
+        m_ContentHashToMetadata.emplace(content_hash, std::move(metadata));
+
+    // Legacy entries stay valid, their content is on the printer only so there is nothing to rehash
+    LogShuiStorageIf(legacy_entries, Display, "% files use legacy content hash, re-uploads of them will be analyzed again", legacy_entries);
+
+    if (migrating) {
+        if(m_Catalog.WriteNow(m_Catalog.Serialize(m_83ToFile, m_ContentHashToMetadata)))
+            MoveLegacyFilesAside();
+
+        LogShuiStorage(Display, "Migrated % files and % metadata to catalog", m_83ToFile.size(), m_ContentHashToMetadata.size());
+    }
+}
+
+std::optional<ShuiCatalogContent> ShuiPrinterStorage::ReadLegacyFiles() {
+    auto files_path = m_OldPath / "files";
+    auto metadata_path = m_OldPath / "metadata";
+
+    if(!std::filesystem::exists(files_path) && !std::filesystem::exists(metadata_path))
+        return std::nullopt;
+
+    ShuiCatalogContent content;
+
+    if (std::filesystem::exists(files_path)) {
+        for (auto file_entry: std::filesystem::directory_iterator(files_path)) {
+            if(!file_entry.is_regular_file())
+                continue;
+
+            try{
+                GCodeFileEntry entry = nlohmann::json::parse(File::ReadEntire(file_entry.path()), nullptr, false, false);
+
+                content.Files.emplace_back(file_entry.path().filename().string(), std::move(entry));
+            }catch (const std::exception &e) {
+                LogShuiStorage(Warning, "Skipping legacy file entry '%': %", file_entry.path().string(), e.what());
+            }
+        }
+    }
+
+    if (std::filesystem::exists(metadata_path)) {
+        for (auto file_entry: std::filesystem::directory_iterator(metadata_path)) {
+            if(!file_entry.is_regular_file())
+                continue;
+
+            auto hash = FromString<std::uint64_t>(file_entry.path().filename().string());
+
+            if(!hash.has_value())
+                continue;
+
+            std::vector<std::string> pngs;
+            auto data = GCodeFileMetadata::ParseFromLegacyJsonFile(file_entry.path(), pngs);
+
+            if(!data.has_value())
+                continue;
+
+            for (const std::string &png : pngs) {
+                if(auto preview = m_Catalog.AppendPreview(png))
+                    data->Previews.push_back(preview.value());
+            }
+            
+            content.Metadata.emplace_back(hash.value(), std::move(data.value()));
+        }
+    }
+
+    return content;
+}
+
+void ShuiPrinterStorage::MoveLegacyFilesAside()const {
+    auto legacy_path = m_OldPath / "legacy";
+
+    std::error_code ec;
+    std::filesystem::create_directories(legacy_path, ec);
+
+    for (const char *directory : {"files", "metadata"}) {
+        if(!std::filesystem::exists(m_OldPath / directory))
+            continue;
+
+        std::filesystem::rename(m_OldPath / directory, legacy_path / directory, ec);
+
+        LogShuiStorageIf((bool)ec, Warning, "Can't move legacy '%' aside: %", directory, ec.message());
+    }
+}
@@ -3,30 +3,102 @@
 #include "printers/file.hpp"
 #include "printers/storage.hpp"
 #include "runtime_data.hpp"
+#include "analyzer.hpp"
+#include "catalog.hpp"
+#include "core/image.hpp"
+#include "core/lru_cache.hpp"
+#include "pacing.hpp"
+#include "arc_fitter.hpp"
+#include "preview_cache.hpp"
+#include <deque>
+#include <unordered_set>
+#include <boost/asio/cancellation_signal.hpp>
+#include <mutex>
+
+struct PreprocessedGCode {
+	std::string GCode;
+	GCodeAnalysis Analysis;
+	std::uint64_t ContentHash = 0;
+	// Content as it came from slicer and as it is sent, previews excluded
+	std::int64_t SourceSize = 0;
+	std::int64_t CompactedSize = 0;
+	// Preview block in front of the content, included in index offsets
+	std::int64_t PreviewSize = 0;
+	GCodeTransform Transform;
+	GCodeArcFitStats ArcFit;
+	// Decoded biggest preview, kept to warm up preview cache once it is stored
+	std::shared_ptr<const Image> Preview;
+};
 
-struct GCodeFileEntry {
+// Root file as listed by M20
+struct ShuiListedFile {
+	std::string Filename83;
+	// Empty unless firmware reports long names, see M20 L
 	std::string LongFilename;
-	std::size_t ContentHash;
-	GCodeFileRuntimeData RuntimeData;
-
-	NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(GCodeFileEntry, LongFilename, ContentHash, RuntimeData);
-
-	static std::optional<GCodeFileEntry> LoadFromFile(std::filesystem::path filepath);
+};
 
-	void SaveToFile(const std::filesystem::path &filepath)const;
+// Content in memory or a spool file, which is removed once read
+using ShuiUploadSource = std::variant<std::string, std::filesystem::path>;
+
+// Preprocessed once, then sent as many times as it takes
+struct ShuiUploadJob {
+	std::uint64_t Id = 0;
+	std::string Filename;
+	bool Print = false;
+	std::shared_ptr<PreprocessedGCode> Processed;
+	std::shared_ptr<const std::string> Content;
+	std::function<void(bool)> Callback;
+	// Content is set once preprocessing finished, unless it failed
+	bool Preprocessed = false;
+	bool Force = false;
+	// Stops retries, whatever attempt is running gets aborted
+	bool Cancelled = false;
+	std::int32_t Attempt = 1;
+	std::string LastError;
+	// First attempt of a forwarded upload goes out while the spool is received, retries use Content
+	std::shared_ptr<GCodeUploadStream> Stream;
+	std::shared_ptr<const std::string> StreamPrefix;
 };
 
 class ShuiPrinterStorage: public PrinterStorage{
 	std::string m_Ip;
 	std::filesystem::path m_OldPath;
-	std::filesystem::path m_FilesPath;
-	std::filesystem::path m_MetadataPath;
+	ShuiCatalog m_Catalog;
 
 	std::optional<PrinterStorageUploadState> m_UploadState;
 	
 	std::unordered_map<std::string, GCodeFileEntry> m_83ToFile;
-
-	std::unordered_map<std::size_t, GCodeFileMetadata> m_ContentHashToMetadata;
+	// Reverse of m_83ToFile, only ever modified through AddEntry and RemoveEntry
+	std::unordered_map<std::string, std::string> m_LongTo83;
+	// Bumped on every uploaded file, listings requested before are outdated
+	std::uint64_t m_Generation = 0;
+	// Absent from the last listing, removed if the next one doesn't have them either
+	std::unordered_set<std::string> m_MissingOnPrinter;
+
+	std::unordered_map<std::uint64_t, GCodeFileMetadata> m_ContentHashToMetadata;
+
+	// Keyed by preview offset, used from worker threads too
+	mutable std::mutex m_PreviewCacheLock;
+	mutable LruCache<std::int64_t, Image> m_PreviewCache;
+
+	// Outlives single uploads, so the rate learned by one upload is where the next one starts
+	std::shared_ptr<ShuiUploadPacing> m_UploadPacing;
+	// Generated preview blocks, shared with preprocessing on workers
+	std::shared_ptr<ShuiPreviewCache> m_ShuiPreviewCache;
+	std::int32_t m_UploadAttempts = 4;
+
+	// One transfer at a time, parallel ones only fight over the printer wifi link
+	std::deque<std::shared_ptr<ShuiUploadJob>> m_UploadQueue;
+	std::shared_ptr<ShuiUploadJob> m_ActiveUpload;
+	// Bound to the transfer or retry delay of the active upload
+	boost::asio::cancellation_signal m_UploadCancel;
+	std::uint64_t m_LastUploadId = 0;
+	bool m_Connected = false;
+	bool m_Printing = false;
+
+	bool m_CompactGCode = false;
+	double m_ArcTolerance = 0;
+	bool m_CutThrough = false;
 public:
 	ShuiPrinterStorage(const std::string& ip, const std::filesystem::path &data_path);
 
@@ -34,26 +106,67 @@ public:
 
 	void Emit(std::optional<PrinterStorageUploadState> upload);
 
-	void UploadGCodeFileAsync(const std::string &filename, const std::string& content, bool print, std::function<void(bool)> callback)override;
+	boost::asio::awaitable<bool> Upload(std::string filename, std::string content, bool print)override;
+
+	boost::asio::awaitable<bool> UploadSpooled(std::string filename, std::filesystem::path spool, bool print, std::function<void(std::uint64_t)> on_queued = nullptr)override;
+
+	std::optional<std::uint64_t> UploadStreamed(const std::string &filename, std::shared_ptr<GCodeUploadStream> stream, bool print, std::function<void(bool)> callback)override;
+
+	void UploadGCodeFileAsync(const std::string &filename, std::string content, bool print, std::function<void(bool)> callback)override;
+
+	bool CancelUpload(std::uint64_t id)override;
+
+	bool ForceUpload(std::uint64_t id)override;
 
-	bool UploadGCodeFile(const std::string &filename, const std::string& content, bool print)override;
+	// Strips what printer doesn't need from uploaded G-code, see GCodeCompactor
+	void SetGCodeCompaction(bool enabled);
+
+	// Merges co-circular moves into G2/G3 within tolerance in mm, 0 disables it. Firmware has to support arcs
+	void SetArcFitting(double tolerance);
+
+	// Forwards uploads while they are still received when nothing else is being sent.
+	// Forwarded content goes out as is, so it is off while compaction or arc fitting is on
+	void SetCutThroughUploads(bool enabled);
+
+	// Queued uploads start only while printer is connected and, unless forced, not printing
+	void SetPrinterState(bool connected, bool printing);
+
+	// Highest rate pacing may reach in bytes per second and biggest single write, printer wifi module drops connection when flooded
+	void SetUploadLimit(std::size_t max_rate, std::size_t burst);
+
+	// Failed async uploads are sent again after a growing delay, zero disables retries
+	void SetUploadRetries(std::int32_t retries);
 
 	//GCodeFile *GetStoredFile(const std::string &filename)const;
 
-	const GCodeFileMetadata *GetMetadata(std::size_t content_hash)const override;
+	const GCodeFileMetadata *GetMetadata(std::uint64_t content_hash)const override;
 
 	const GCodeFileMetadata *GetMetadata(const std::string& filename)const override;
 
-	std::optional<std::size_t> GetContentHashForFilename(const std::string &filename)const override;
+	std::optional<std::uint64_t> GetContentHashForFilename(const std::string &filename)const override;
 
-	std::optional<std::size_t> GetContentHashFor83Filename(const std::string &_83_filename)const;
+	std::optional<std::uint64_t> GetContentHashFor83Filename(const std::string &_83_filename)const;
+
+	std::optional<std::string> ReadPreview(const GCodePreviewRef &preview)const override;
+
+	// Biggest preview, decoded on cache miss. Safe to call from worker threads
+	std::shared_ptr<const Image> GetPreviewImage(const GCodeFileMetadata &metadata)const;
 
 	//std::vector<std::string> GetStoredFiles()const;
 
-	std::string PreprocessGCode(const std::string &content);
+	// Doesn't touch storage state, safe to call from worker threads
+	// Known analysis has to be of content gone through the same transform, with index offsets starting right after the preview
+	static PreprocessedGCode PreprocessGCode(const std::string &content, std::uint64_t content_hash, const GCodeAnalysis *known_analysis = nullptr, const std::string *known_preview_png = nullptr, ShuiPreviewCache *preview_cache = nullptr, const GCodeTransform &transform = {});
+
+	// Thumbnail as a SHUI preview block, generated on cache miss only. Safe to call from worker threads
+	static std::string MakePreviewBlock(std::string_view png, ShuiPreviewCache *preview_cache, std::shared_ptr<const Image> *decoded = nullptr);
+
+	// Index comes back with offsets starting right after the preview, as PreprocessGCode takes it
+	std::optional<GCodeAnalysis> FindAnalysis(std::uint64_t content_hash, const GCodeTransform &transform)const;
 
 	const GCodeFileRuntimeData *GetRuntimeData(const std::string &long_filename)const;
 
+	// Nullptr for files that weren't uploaded through proxy too
 	const std::string *GetLongFilename(const std::string &_83_filename)const;
 
 	const std::string *Get83Filename(const std::string &long_filename)const;
@@ -68,12 +181,55 @@ public:
 
 	std::string ConvertTo83Revisioned(const std::string& long_filename, std::int16_t revision)const;
 
+	std::uint64_t Generation()const;
+
+	// Printer side changes (deleted from screen, sd card swapped) are only visible through its listing
+	bool CanReconcile()const;
+
+	// Applies only added and removed files, listing is dropped if storage changed since generation.
+	// Files uploaded through proxy are matched by long name too, as 8.3 name is only a guess of what firmware made of it
+	void Reconcile(const std::vector<ShuiListedFile> &listed, std::uint64_t generation);
+
+	// Drops metadata of content neither a stored file nor retained refers to and compacts previews.
+	// Meant for startup, before anything else touches storage
+	void PruneCatalog(const std::unordered_set<std::uint64_t> &retained);
+
+	// Root files from M20 result, nullopt unless whole list was received
+	static std::optional<std::vector<ShuiListedFile>> ParseFileList(const std::string &m20_result);
+
 private:
-	bool OnFileUploaded(const std::string &filename, const std::string &content);
+	GCodeFileEntry &AddEntry(const std::string &_83, GCodeFileEntry &&entry);
+
+	void RemoveEntry(const std::string &_83);
+
+	boost::asio::awaitable<bool> UploadFrom(std::string filename, ShuiUploadSource source, bool print, std::function<void(std::uint64_t)> on_queued = nullptr);
+
+	std::shared_ptr<ShuiUploadJob> EnqueueUpload(const std::string &filename, ShuiUploadSource source, bool print, std::function<void(bool)> callback);
+
+	// Hashes and preprocesses on workers, job content is set once completion is called. Untransformed content is analyzed anew
+	void PreprocessAsync(std::shared_ptr<ShuiUploadJob> job, ShuiUploadSource source, bool transform, std::function<void()> completion);
 
-	void Save(const GCodeFileEntry& entry, const std::string& _83)const;
+	void PumpUploadQueue();
 
-	void Save(const GCodeFileMetadata& entry, std::size_t content_hash)const;
+	static void LogSizeReduction(const std::string &filename, const PreprocessedGCode &processed);
+
+	void UploadAttemptAsync(std::shared_ptr<ShuiUploadJob> job);
+
+	void OnUploadAttemptFinished(std::shared_ptr<ShuiUploadJob> job, const std::string &error);
+
+	void StreamedAttemptAsync(std::shared_ptr<ShuiUploadJob> job);
+
+	void OnStreamedAttemptFinished(std::shared_ptr<ShuiUploadJob> job, const std::string &error);
+
+	PrinterStorageUploadState MakeUploadState(const ShuiUploadJob &job, std::int32_t current = 0, std::int32_t target = 0)const;
+
+	bool OnFileUploaded(const std::string &filename, PreprocessedGCode &&gcode);
+
+	void SaveCatalog();
 
 	void Load();
+
+	std::optional<ShuiCatalogContent> ReadLegacyFiles();
+
+	void MoveLegacyFilesAside()const;
 };
@@ -4,46 +4,53 @@
 #include <sstream>
 #include <iomanip>
 #include <bsl/log.hpp>
+#include <boost/beast/core/buffers_prefix.hpp>
+#include <boost/beast/http/write.hpp>
 
-ShuiUpload::ShuiUpload(boost::asio::io_context &context, const std::string& ip, const std::string& filename, std::string&& content, bool start_printing, CompletionCallback callback, ProgressCallback progress): 
+static constexpr std::size_t ChunkSize = 8 * 1024; // 8KB
+static constexpr std::size_t SourceChunkSize = 64 * 1024; // 64KB
+// Printer that accepted the connection may still stop responding, upload then fails and is retried
+static constexpr auto MaxIdleDuration = std::chrono::seconds(15);
+
+ShuiUpload::ShuiUpload(boost::asio::io_context &context, const std::string& ip, const std::string& filename, std::shared_ptr<const std::string> content, bool start_printing, CompletionCallback callback, ProgressCallback progress, std::shared_ptr<ShuiUploadPacing> pacing): 
     m_Socket(context), 
     m_Ip(ip), 
     m_Filename(filename), 
     m_Content(std::move(content)), 
     m_StartPrinting(start_printing), 
     m_Callback(callback),
-    m_Progress(progress)
+    m_Progress(progress),
+    m_Pacing(pacing),
+    m_PaceTimer(context),
+    m_IdleTimer(context)
 {
     m_Boundary = GenerateBoundary();
 }
 
 
-void ShuiUpload::RunAsync(const std::string& ip, const std::string& filename, std::string&& content, bool start_printing, CompletionCallback callback, ProgressCallback progress) {
-    std::make_shared<ShuiUpload>(Async::Context(), ip, filename, std::move(content), start_printing, callback, progress)->Connect();
-}
-
-std::optional<std::string> ShuiUpload::Run(const std::string& ip, const std::string& filename, const std::string& content, bool start_printing, ProgressCallback progress) {
-    boost::asio::io_context blocking_context;
-
-    std::optional<std::variant<std::string, const std::string*>> result_opt;
-
-    auto upload = std::make_shared<ShuiUpload>(blocking_context, ip, filename, std::string(content), start_printing, [&](std::variant<std::string, const std::string*> got_result) {
-        result_opt = std::move(got_result);
-    }, progress);
-
-    upload->Connect();
-    
-    //Limit file upload to one minute to fix freezes on error
-    static constexpr const auto MaxOpDuration = std::chrono::seconds(15);
+void ShuiUpload::Cancel() {
+    if(m_Completed)
+        return;
 
-    while(blocking_context.run_one_for(MaxOpDuration));
+    m_Cancelled = true;
 
-    if(!result_opt.has_value())
-        return "Hard Timeout";
+    // Pending connect, write, read or pacing wait finishes with operation_aborted
+    boost::beast::error_code ec;
+    m_Socket.close(ec);
+    m_PaceTimer.cancel();
+    m_IdleTimer.cancel();
 
-    const auto &result = result_opt.value();
+    // Nothing pending to abort, the slicer may take its time
+    if (m_WaitingForSource) {
+        boost::asio::post(m_Socket.get_executor(), [self = shared_from_this()]() {
+            self->Complete("Cancelled");
+        });
+    }
+}
 
-    return result.index() == 0 ? std::optional<std::string>(std::get<0>(result)) : std::nullopt;
+TokenBucket& ShuiUpload::GlobalLimit() {
+    static TokenBucket s_GlobalLimit;
+    return s_GlobalLimit;
 }
 
 std::string ShuiUpload::GenerateBoundary() {
@@ -59,8 +66,8 @@ std::string ShuiUpload::GenerateBoundary() {
     return ss.str();
 }
 
-boost::beast::http::request<boost::beast::http::string_body> ShuiUpload::CreateMultipartRequest() {
-    boost::beast::http::request<boost::beast::http::string_body> req{boost::beast::http::verb::post, "/upload", 11};
+boost::beast::http::request<boost::beast::http::empty_body> ShuiUpload::CreateMultipartRequest() {
+    boost::beast::http::request<boost::beast::http::empty_body> req{boost::beast::http::verb::post, "/upload", 11};
     req.set(boost::beast::http::field::host, m_Ip);
     req.set(boost::beast::http::field::content_type, "multipart/form-data; boundary=" + m_Boundary);
     
@@ -68,15 +75,12 @@ boost::beast::http::request<boost::beast::http::string_body> ShuiUpload::CreateM
         req.set("Start-Printing", "1");
     }
     
-    std::string body;
-    body += "--" + m_Boundary + "\r\n";
-    body += "Content-Disposition: form-data; name=\"file\"; filename=\"" + m_Filename + "\"\r\n";
-    body += "\r\n";
-    body += m_Content;
-    body += "\r\n--" + m_Boundary + "--\r\n";
+    m_Preamble = "--" + m_Boundary + "\r\n";
+    m_Preamble += "Content-Disposition: form-data; name=\"file\"; filename=\"" + m_Filename + "\"\r\n";
+    m_Preamble += "\r\n";
+    m_Epilogue = "\r\n--" + m_Boundary + "--\r\n";
     
-    req.body() = body;
-    req.prepare_payload();
+    req.content_length(m_Preamble.size() + ContentSize() + m_Epilogue.size());
     
     return req;
 }
@@ -85,81 +89,203 @@ void ShuiUpload::Connect() {
     boost::beast::error_code ec;
     boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address(m_Ip, ec), 80);
     if(ec) {
-        if (m_Callback) {
-            m_Callback("Invalid IP address: " + ec.message());
-        }
+        Complete("Invalid IP address: " + ec.message());
         return;
     }
 
+    ArmIdleTimer();
     m_Socket.async_connect(endpoint, boost::beast::bind_front_handler(&ShuiUpload::OnConnect, shared_from_this()));
 }
 
+void ShuiUpload::ArmIdleTimer() {
+    // Re-arming cancels the previous wait
+    m_IdleTimer.expires_after(MaxIdleDuration);
+    m_IdleTimer.async_wait([this, self = shared_from_this()](boost::beast::error_code ec) {
+        if(ec || m_Completed)
+            return;
+
+        m_TimedOut = true;
+
+        // Pending operation finishes with operation_aborted
+        boost::beast::error_code close_ec;
+        m_Socket.close(close_ec);
+    });
+}
+
 void ShuiUpload::OnConnect(boost::beast::error_code ec) {
     if(ec) {
-        if (m_Callback) {
-            m_Callback("Connect failed: " + ec.message());
-        }
+        Complete("Connect failed: " + ec.message());
         return;
     }
     
+    // Otherwise the kernel takes whole chunks at once and write duration says nothing about the printer
+    if (m_Pacing) {
+        boost::beast::error_code option_ec;
+        m_Socket.set_option(boost::asio::socket_base::send_buffer_size(ChunkSize * 2), option_ec);
+    }
+
+    if (m_Source) {
+        m_SourceFile.rdbuf()->pubsetbuf(nullptr, 0);
+        m_SourceFile.open(m_Source->Path(), std::ios::binary);
+
+        if (!m_SourceFile.is_open()) {
+            Complete("Can't open spool file");
+            return;
+        }
+    }
+
     m_Request = CreateMultipartRequest();
 
     std::ostringstream ss;
-    ss << m_Request;
-    m_SerializedRequest = ss.str();
+    ss << m_Request.base();
+    m_Header = ss.str();
+
+    m_Remaining = boost::beast::buffers_suffix<RequestBuffers>(RequestBuffers{
+        boost::asio::buffer(m_Header),
+        boost::asio::buffer(m_Preamble),
+        boost::asio::buffer(*m_Content),
+        // Streamed content ends with padding, epilogue is queued after it
+        m_Source ? boost::asio::const_buffer() : boost::asio::buffer(m_Epilogue)
+    });
+    m_RequestSize = m_Header.size() + m_Preamble.size() + ContentSize() + m_Epilogue.size();
     
     m_BytesWritten = 0;
     WriteNextChunk();    
 }
 
+std::int64_t ShuiUpload::ContentSize()const {
+    return m_Content->size() + (m_Source ? m_Source->SizeBound() : 0);
+}
+
 void ShuiUpload::WriteNextChunk() {
-    static constexpr std::size_t AllowedBandwidth = 40 * 1024; //40KB/s
-    static constexpr std::size_t ChunkSize = 8 * 1024; // 8KB
-    static constexpr std::size_t ChunksPerSecond = AllowedBandwidth / ChunkSize; // 8KB
-    static constexpr auto SleepBetweenChunks = std::chrono::milliseconds(1000 / ChunksPerSecond);
-    
-    if (m_BytesWritten >= m_SerializedRequest.size()) {
+    if (m_BytesWritten >= m_RequestSize) {
         OnWrite(boost::beast::error_code{}, m_BytesWritten);
         return;
     }
-    std::size_t remaining = m_SerializedRequest.size() - m_BytesWritten;
-    std::size_t to_write = std::min(ChunkSize, remaining);
+
+    if (m_Source && !boost::beast::buffer_bytes(m_Remaining) && !ReadSource())
+        return;
+
+    TokenBucket &global = GlobalLimit();
+    // Chunk bigger than burst would never fit into the bucket
+    std::size_t chunk_size = std::min({ChunkSize, boost::beast::buffer_bytes(m_Remaining), global.Burst(), m_Pacing ? m_Pacing->Bucket().Burst() : ChunkSize});
     
-    auto buffer = boost::asio::buffer(m_SerializedRequest.data() + m_BytesWritten, to_write);
+    auto delay = std::max(global.Delay(chunk_size), m_Pacing ? m_Pacing->Bucket().Delay(chunk_size) : TokenBucket::Clock::duration::zero());
+
+    if (delay > TokenBucket::Clock::duration::zero()) {
+        // Own wait, printer is not to blame for it
+        m_IdleTimer.cancel();
+
+        // Waits on the timer instead of sleeping, so the io thread keeps serving everything else
+        m_PaceTimer.expires_after(delay);
+        m_PaceTimer.async_wait([this, self = shared_from_this()](boost::beast::error_code ec) {
+            if (ec) {
+                OnWrite(ec, m_BytesWritten);
+                return;
+            }
+
+            WriteNextChunk();
+        });
+        return;
+    }
+
+    global.Consume(chunk_size);
+    if (m_Pacing)
+        m_Pacing->Bucket().Consume(chunk_size);
     
-    std::this_thread::sleep_for(SleepBetweenChunks);
+    // Chunk may span several parts, they are gathered by the socket
+    auto buffer = boost::beast::buffers_prefix(chunk_size, m_Remaining);
     
+    m_WriteStarted = TokenBucket::Clock::now();
+
+    ArmIdleTimer();
     boost::asio::async_write(m_Socket, buffer,
         [this, self = shared_from_this()](boost::beast::error_code ec, std::size_t bytes) {
             if (ec) {
+                // Own cancellation says nothing about the link, a printer that stopped reading does
+                if (m_Pacing && !m_Cancelled && (m_TimedOut || ec != boost::asio::error::operation_aborted))
+                    m_Pacing->OnWriteFailed();
+
                 OnWrite(ec, m_BytesWritten);
                 return;
             }
+
+            if (m_Pacing)
+                m_Pacing->OnWriteCompleted(bytes, m_WriteStarted, TokenBucket::Clock::now());
             
+            m_Remaining.consume(bytes);
             m_BytesWritten += bytes;
 
-            std::call(m_Progress, m_BytesWritten, m_SerializedRequest.size());
+            std::call(m_Progress, m_BytesWritten, m_RequestSize);
 
             WriteNextChunk();
         });
 }
 
+bool ShuiUpload::ReadSource() {
+    m_WaitingForSource = false;
+
+    if (m_Completed)
+        return false;
+
+    if (m_Source->IsFailed()) {
+        Complete("Source upload was interrupted");
+        return false;
+    }
+
+    if (m_Source->Size() > m_Source->SizeBound()) {
+        Complete("Source is bigger than announced");
+        return false;
+    }
+
+    std::int64_t available = m_Source->Size() - m_SourceRead;
+
+    if (available > 0) {
+        m_SourceChunk.resize(std::min<std::int64_t>(available, SourceChunkSize));
+
+        if (!m_SourceFile.read(m_SourceChunk.data(), m_SourceChunk.size())) {
+            Complete("Can't read spool file");
+            return false;
+        }
+
+        m_SourceRead += m_SourceChunk.size();
+        m_Remaining = boost::beast::buffers_suffix<RequestBuffers>(RequestBuffers{boost::asio::buffer(m_SourceChunk)});
+        return true;
+    }
+
+    if (!m_Source->IsFinished()) {
+        // Slicer may take its time, printer is idle meanwhile by design
+        m_IdleTimer.cancel();
+        m_WaitingForSource = true;
+        m_Source->Wait([this, self = shared_from_this()]() {
+            if(m_WaitingForSource)
+                WriteNextChunk();
+        });
+        return false;
+    }
+
+    // Printer got the length before the size was known, empty lines make up the difference
+    m_SourceChunk.assign(m_Source->SizeBound() - m_SourceRead, '\n');
+    m_Remaining = boost::beast::buffers_suffix<RequestBuffers>(RequestBuffers{
+        boost::asio::buffer(m_SourceChunk),
+        boost::asio::buffer(m_Epilogue)
+    });
+    return true;
+}
+
 void ShuiUpload::OnWrite(boost::beast::error_code ec, std::size_t bytes_transferred) {
     if(ec) {
-        if (m_Callback) {
-            m_Callback("Write failed: " + ec.message());
-        }
+        Complete("Write failed: " + ec.message());
         return;
     }
     
+    ArmIdleTimer();
     boost::beast::http::async_read(m_Socket, m_Buffer, m_Response, boost::beast::bind_front_handler(&ShuiUpload::OnRead, shared_from_this()));
 }
 
 void ShuiUpload::OnRead(boost::beast::error_code ec, std::size_t bytes_transferred) {
     if(ec && ec != boost::beast::errc::not_connected) {
-        if (m_Callback) {
-            m_Callback("Read failed: " + ec.message());
-        }
+        Complete("Read failed: " + ec.message());
         return;
     }
     
@@ -167,15 +293,28 @@ void ShuiUpload::OnRead(boost::beast::error_code ec, std::size_t bytes_transferr
                   m_Response.result() == boost::beast::http::status::created || 
                   m_Response.result() == boost::beast::http::status::accepted;
 
-    if (m_Callback) {
-        if (success) {
-            m_Callback(&m_Content);
-        } else {
-            m_Callback("Server returned error code: " + 
-                      std::to_string(static_cast<int>(m_Response.result())));
-        }
+    if (success) {
+        Complete(std::nullopt);
+    } else {
+        Complete("Server returned error code: " + 
+                  std::to_string(static_cast<int>(m_Response.result())));
     }
     
     boost::beast::error_code close_ec;
     m_Socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, close_ec);
+}
+
+void ShuiUpload::Complete(std::optional<std::string> error) {
+    if(m_Completed)
+        return;
+
+    m_Completed = true;
+    m_IdleTimer.cancel();
+
+    if(error.has_value() && m_Cancelled)
+        error = "Cancelled";
+    else if(error.has_value() && m_TimedOut)
+        error = "Printer didn't respond for " + std::to_string(MaxIdleDuration.count()) + "s";
+
+    std::call(m_Callback, std::move(error));
 }
\ No newline at end of file
@@ -2,45 +2,136 @@
 
 #include "pch/std.hpp"
 #include "pch/asio.hpp"
+#include "pacing.hpp"
+#include "core/async.hpp"
+#include "printers/upload_stream.hpp"
+#include <fstream>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/associated_cancellation_slot.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/beast/core/buffers_suffix.hpp>
+#include <boost/beast/http/empty_body.hpp>
 
 class ShuiUpload: public std::enable_shared_from_this<ShuiUpload> {
 public:
-    using CompletionCallback = std::function<void(std::variant<std::string, const std::string*>)>;
+    // Error message, nullopt once printer accepted the file
+    using CompletionCallback = std::function<void(std::optional<std::string>)>;
     using ProgressCallback = std::function<void(std::int64_t, std::int64_t)>;
 
 private:
+    // Header, multipart preamble, content and epilogue, written as is without joining into one body
+    using RequestBuffers = std::array<boost::asio::const_buffer, 4>;
+
     boost::asio::ip::tcp::socket m_Socket;
     std::string m_Ip;
     std::string m_Filename;
-    std::string m_Content;
+    // Shared with the caller, so a failed upload can be retried without another copy
+    std::shared_ptr<const std::string> m_Content;
+    // Streamed uploads send m_Content first and then the spool as it grows
+    std::shared_ptr<GCodeUploadStream> m_Source;
+    std::ifstream m_SourceFile;
+    std::string m_SourceChunk;
+    std::int64_t m_SourceRead = 0;
+    bool m_WaitingForSource = false;
     bool m_StartPrinting;
     std::string m_Boundary;
     CompletionCallback m_Callback;
     ProgressCallback m_Progress;
-    boost::beast::http::request<boost::beast::http::string_body> m_Request;
-    std::string m_SerializedRequest;
+    std::shared_ptr<ShuiUploadPacing> m_Pacing;
+    boost::asio::steady_timer m_PaceTimer;
+    // Closes the socket when printer doesn't complete an operation in time
+    boost::asio::steady_timer m_IdleTimer;
+    boost::beast::http::request<boost::beast::http::empty_body> m_Request;
+    std::string m_Header;
+    std::string m_Preamble;
+    std::string m_Epilogue;
+    boost::beast::buffers_suffix<RequestBuffers> m_Remaining;
+    std::size_t m_RequestSize = 0;
     std::size_t m_BytesWritten = 0;
+    TokenBucket::Clock::time_point m_WriteStarted;
     boost::beast::flat_buffer m_Buffer;
     boost::beast::http::response<boost::beast::http::string_body> m_Response;
+    bool m_Cancelled = false;
+    bool m_TimedOut = false;
+    bool m_Completed = false;
 
 public:
-    ShuiUpload(boost::asio::io_context& context, const std::string& ip, const std::string& filename, std::string&& content, bool start_printing = false, CompletionCallback callback = nullptr, ProgressCallback progress = nullptr);
+    ShuiUpload(boost::asio::io_context& context, const std::string& ip, const std::string& filename, std::shared_ptr<const std::string> content, bool start_printing = false, CompletionCallback callback = nullptr, ProgressCallback progress = nullptr, std::shared_ptr<ShuiUploadPacing> pacing = nullptr);
     
-    static void RunAsync(const std::string& ip, const std::string& filename, std::string&& content, bool start_printing = false, CompletionCallback callback = nullptr, ProgressCallback progress = nullptr);
+    // Runs on Async::Context() and completes with void(std::optional<std::string> error), works with callbacks and use_awaitable alike.
+    // Cancellation slot of the handler aborts the transfer
+    template<typename CompletionToken>
+    static auto AsyncUpload(const std::string& ip, const std::string& filename, std::shared_ptr<const std::string> content, bool start_printing, ProgressCallback progress, std::shared_ptr<ShuiUploadPacing> pacing, CompletionToken&& token) {
+        return AsyncStart(ip, filename, std::move(content), nullptr, start_printing, std::move(progress), std::move(pacing), std::forward<CompletionToken>(token));
+    }
+
+    // Same, but sends prefix and then the stream as it is received. Printer needs the length up front,
+    // so the request announces the stream size bound and the content is padded with empty lines up to it
+    template<typename CompletionToken>
+    static auto AsyncUploadStreamed(const std::string& ip, const std::string& filename, std::shared_ptr<const std::string> prefix, std::shared_ptr<GCodeUploadStream> source, bool start_printing, ProgressCallback progress, std::shared_ptr<ShuiUploadPacing> pacing, CompletionToken&& token) {
+        return AsyncStart(ip, filename, std::move(prefix), std::move(source), start_printing, std::move(progress), std::move(pacing), std::forward<CompletionToken>(token));
+    }
 
-    static std::optional<std::string> Run(const std::string& ip, const std::string& filename, const std::string& content, bool start_printing = false, ProgressCallback progress = nullptr);
+    // Closes the connection, upload completes with an error
+    void Cancel();
+
+    // Shared by uploads to all printers on top of their own limit, unlimited by default
+    static TokenBucket& GlobalLimit();
 private:
+    template<typename CompletionToken>
+    static auto AsyncStart(const std::string& ip, const std::string& filename, std::shared_ptr<const std::string> content, std::shared_ptr<GCodeUploadStream> source, bool start_printing, ProgressCallback progress, std::shared_ptr<ShuiUploadPacing> pacing, CompletionToken&& token) {
+        auto Initiate = [](auto handler, std::string ip, std::string filename, std::shared_ptr<const std::string> content, std::shared_ptr<GCodeUploadStream> source, bool start_printing, ProgressCallback progress, std::shared_ptr<ShuiUploadPacing> pacing) {
+            auto slot = boost::asio::get_associated_cancellation_slot(handler);
+            auto executor = boost::asio::get_associated_executor(handler, Async::Context().get_executor());
+            // Handlers may be move only, std::function needs a copyable one
+            auto shared_handler = std::make_shared<decltype(handler)>(std::move(handler));
+
+            auto OnCompleted = [slot, executor, shared_handler](std::optional<std::string> error)mutable {
+                if(slot.is_connected())
+                    slot.clear();
+
+                boost::asio::dispatch(executor, [shared_handler, error = std::move(error)]()mutable {
+                    (*shared_handler)(std::move(error));
+                });
+            };
+
+            auto upload = std::make_shared<ShuiUpload>(Async::Context(), ip, filename, std::move(content), start_printing, std::move(OnCompleted), std::move(progress), std::move(pacing));
+            upload->m_Source = std::move(source);
+
+            if (slot.is_connected()) {
+                slot.assign([weak = std::weak_ptr<ShuiUpload>(upload)](boost::asio::cancellation_type) {
+                    if(auto upload = weak.lock())
+                        upload->Cancel();
+                });
+            }
+
+            upload->Connect();
+        };
+
+        return boost::asio::async_initiate<CompletionToken, void(std::optional<std::string>)>(Initiate, token, ip, filename, std::move(content), std::move(source), start_printing, std::move(progress), std::move(pacing));
+    }
+
     std::string GenerateBoundary();
 
-    boost::beast::http::request<boost::beast::http::string_body> CreateMultipartRequest();
+    boost::beast::http::request<boost::beast::http::empty_body> CreateMultipartRequest();
 
     void Connect();
 
+    // Armed before every connect, write and read, anything not waiting on the printer disarms it
+    void ArmIdleTimer();
+
     void OnConnect(boost::beast::error_code ec);
 
+    std::int64_t ContentSize()const;
+
     void WriteNextChunk();
 
+    // Next part of the spool, false when there is nothing to send yet or the upload completed
+    bool ReadSource();
+
     void OnWrite(boost::beast::error_code ec, std::size_t bytes_transferred);
 
     void OnRead(boost::beast::error_code ec, std::size_t bytes_transferred);
+
+    void Complete(std::optional<std::string> error);
 };
\ No newline at end of file
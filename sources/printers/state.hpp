@@ -20,7 +20,8 @@ struct PrintState {
 	std::int64_t Layer = 0;
 	float Height = 0.f;
 	PrintStatus Status = PrintStatus::Busy;
-	//Remaining time
+	// Slicer estimate scaled by current feed rate
+	std::optional<std::int64_t> RemainingSeconds;
 };
 
 struct PrinterState {
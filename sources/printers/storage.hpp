@@ -2,23 +2,43 @@
 
 #include "pch/std.hpp"
 #include <bsl/enum.hpp>
+#include <boost/asio/awaitable.hpp>
 #include "printers/file.hpp"
 #include "printers/history.hpp"
 #include "printers/state.hpp"
+#include "printers/upload_stream.hpp"
 
 #define WITH_PRINTER_DEBUG 0
 
 BSL_ENUM(PrinterStorageUploadStatus,
+	// Waiting for earlier uploads or for the print to finish
+	Queued,
 	Sending,
+	// Previous attempt failed with Error, next one starts after a backoff
+	Retrying,
 	Success,
 	Failure
 );
 
+struct PrinterStorageQueuedUpload {
+	std::uint64_t Id = 0;
+	std::string Filename;
+	// Starts even while printer is printing
+	bool Force = false;
+};
+
 struct PrinterStorageUploadState {
+	std::uint64_t Id = 0;
 	std::int32_t Current = 0;
 	std::int32_t Target = 0;
 	std::string Filename;
 	PrinterStorageUploadStatus Status = PrinterStorageUploadStatus::Sending;
+	std::int32_t Attempt = 1;
+	std::int32_t MaxAttempts = 1;
+	// Reason of the last failed attempt
+	std::string Error;
+	// Uploads waiting after this one, in order they are going to be sent
+	std::vector<PrinterStorageQueuedUpload> Queue;
 
 	PrinterStorageUploadState(const std::string &filename, std::int32_t current = 0, std::int32_t target = 0):
 		Filename(filename),
@@ -32,13 +52,33 @@ struct PrinterStorage {
 
 	virtual std::optional<PrinterStorageUploadState> GetUploadState()const = 0;
 
-	virtual void UploadGCodeFileAsync(const std::string &filename, const std::string& content, bool print, std::function<void(bool)> callback) = 0;
+	// Resolves once the file is on the printer or every attempt failed, awaited on Async::Context().
+	// Cancelling the awaiting operation cancels the upload
+	virtual boost::asio::awaitable<bool> Upload(std::string filename, std::string content, bool print) = 0;
+
+	// Same, but content is read from a spool file, which is removed afterwards.
+	// On queued gets the id the upload has in GetUploadState
+	virtual boost::asio::awaitable<bool> UploadSpooled(std::string filename, std::filesystem::path spool, bool print, std::function<void(std::uint64_t)> on_queued = nullptr) = 0;
 
-	virtual bool UploadGCodeFile(const std::string &filename, const std::string& content, bool print) = 0;
+	// Starts sending while the spool is still being received, storage takes the spool over once it is finished.
+	// Returns the id the upload has in GetUploadState, nullopt when the file can't be forwarded right away,
+	// it is then uploaded with UploadSpooled as usual. Callback gets the same result UploadSpooled would resolve with
+	virtual std::optional<std::uint64_t> UploadStreamed(const std::string &filename, std::shared_ptr<GCodeUploadStream> stream, bool print, std::function<void(bool)> callback){ return std::nullopt; };
+
+	// Same upload for callers without a coroutine
+	virtual void UploadGCodeFileAsync(const std::string &filename, std::string content, bool print, std::function<void(bool)> callback) = 0;
+
+	// Queued upload is dropped, the one being sent is aborted
+	virtual bool CancelUpload(std::uint64_t id){ return false; };
+
+	// Moves queued upload to the front and lets it start while printing
+	virtual bool ForceUpload(std::uint64_t id){ return false; };
 
 	virtual const GCodeFileMetadata *GetMetadata(const std::string &filename)const{ return nullptr; };
 
-	virtual const GCodeFileMetadata *GetMetadata(std::size_t content_hash)const{ return nullptr; };
+	virtual const GCodeFileMetadata *GetMetadata(std::uint64_t content_hash)const{ return nullptr; };
+
+	virtual std::optional<std::uint64_t> GetContentHashForFilename(const std::string &filename)const{ return std::nullopt; };
 
-	virtual std::optional<std::size_t> GetContentHashForFilename(const std::string &filename)const{ return std::nullopt; };
+	virtual std::optional<std::string> ReadPreview(const GCodePreviewRef &preview)const{ return std::nullopt; };
 };
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include "upload_stream.hpp"
+
+GCodeUploadStream::GCodeUploadStream(const std::filesystem::path &path, std::int64_t size_bound):
+	m_Path(path),
+	m_SizeBound(size_bound)
+{}
+
+const std::filesystem::path &GCodeUploadStream::Path()const {
+	return m_Path;
+}
+
+std::int64_t GCodeUploadStream::SizeBound()const {
+	return m_SizeBound;
+}
+
+std::int64_t GCodeUploadStream::Size()const {
+	return m_Size;
+}
+
+bool GCodeUploadStream::IsFinished()const {
+	return m_Finished;
+}
+
+bool GCodeUploadStream::IsFailed()const {
+	return m_Failed;
+}
+
+void GCodeUploadStream::Grow(std::int64_t size) {
+	if(m_Finished || size <= m_Size)
+		return;
+
+	m_Size = size;
+	Notify();
+}
+
+void GCodeUploadStream::Finish(bool success) {
+	if(m_Finished)
+		return;
+
+	m_Finished = true;
+	m_Failed = !success;
+	Notify();
+}
+
+void GCodeUploadStream::Wait(std::function<void()> callback) {
+	m_Waiters.push_back(std::move(callback));
+}
+
+void GCodeUploadStream::Notify() {
+	// Waiters usually wait again right away
+	auto waiters = std::move(m_Waiters);
+	m_Waiters.clear();
+
+	for (auto &waiter : waiters)
+		std::call(waiter);
+}
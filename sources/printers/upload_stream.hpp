@@ -0,0 +1,37 @@
+#pragma once
+
+#include "pch/std.hpp"
+
+// Spool file that is still being received while the printer upload already reads it, lives on Async::Context()
+class GCodeUploadStream {
+	std::filesystem::path m_Path;
+	// Whole request body, the file part can't be bigger
+	std::int64_t m_SizeBound = 0;
+	std::int64_t m_Size = 0;
+	bool m_Finished = false;
+	bool m_Failed = false;
+	std::vector<std::function<void()>> m_Waiters;
+public:
+	GCodeUploadStream(const std::filesystem::path &path, std::int64_t size_bound);
+
+	const std::filesystem::path &Path()const;
+
+	std::int64_t SizeBound()const;
+
+	// Bytes flushed to the spool so far
+	std::int64_t Size()const;
+
+	bool IsFinished()const;
+
+	// Receiving was interrupted, spool is incomplete
+	bool IsFailed()const;
+
+	void Grow(std::int64_t size);
+
+	void Finish(bool success);
+
+	// Called once, on the next growth or when finished
+	void Wait(std::function<void()> callback);
+private:
+	void Notify();
+};
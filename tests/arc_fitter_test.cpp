@@ -0,0 +1,137 @@
+#include "test.hpp"
+#include "gcode_fixture.hpp"
+#include "printers/shui/arc_fitter.hpp"
+#include "printers/shui/analyzer.hpp"
+
+static constexpr double Tolerance = 0.02;
+
+// Perimeters of the fixture are centered here, radius is 20, 21 or 22 depending on layer
+static constexpr double CenterX = 100;
+static constexpr double CenterY = 100;
+
+static std::vector<std::string_view> LinesWith(std::string_view content, std::string_view what) {
+    std::vector<std::string_view> lines;
+
+    ForEachLine(content, [&](std::string_view line) {
+        if(line.find(what) != std::string_view::npos)
+            lines.push_back(line);
+    });
+
+    return lines;
+}
+
+static void PerimetersBecomeArcs() {
+    std::string source = MakeLayeredGCode(10);
+    GCodeArcFitStats stats;
+
+    std::string result = GCodeArcFitter::Fit(source, Tolerance, &stats);
+
+    CHECK(stats.Arcs >= 10);
+    CHECK(stats.MergedSegments > 10 * 100);
+    CHECK(result.size() < source.size() / 2);
+    CHECK(LinesWith(result, "G2 ").size() + LinesWith(result, "G3 ").size() == std::size_t(stats.Arcs));
+}
+
+static void ArcsStayOnPerimeter() {
+    std::string result = GCodeArcFitter::Fit(MakeLayeredGCode(10), Tolerance);
+    double x = 0, y = 0;
+    int arcs = 0;
+
+    ForEachLine(result, [&](std::string_view line) {
+        bool arc = line.starts_with("G2 ") || line.starts_with("G3 ");
+
+        if (arc) {
+            double center_x = x + GCodeParam(line, 'I').value_or(0);
+            double center_y = y + GCodeParam(line, 'J').value_or(0);
+            double radius = std::hypot(x - center_x, y - center_y);
+            double end_x = GCodeParam(line, 'X').value_or(x);
+            double end_y = GCodeParam(line, 'Y').value_or(y);
+
+            // Perimeters go counterclockwise
+            CHECK(line.starts_with("G3 "));
+            CHECK(std::abs(std::hypot(end_x - center_x, end_y - center_y) - radius) < Tolerance);
+
+            // Whole arc stays on the perimeter it replaces, polygon of the fixture is off its circle by less than 0.01
+            double perimeter = std::round(std::hypot(x - CenterX, y - CenterY));
+            double from = std::atan2(y - center_y, x - center_x);
+            double sweep = std::atan2(end_y - center_y, end_x - center_x) - from;
+            if(sweep <= 0)
+                sweep += 2 * std::numbers::pi;
+
+            for (int i = 0; i <= 32; i++) {
+                double angle = from + sweep * i / 32;
+                double distance = std::hypot(center_x + radius * std::cos(angle) - CenterX, center_y + radius * std::sin(angle) - CenterY);
+
+                CHECK(std::abs(distance - perimeter) < Tolerance + 0.01);
+            }
+
+            arcs++;
+        }
+
+        if (arc || line.starts_with("G1 ")) {
+            x = GCodeParam(line, 'X').value_or(x);
+            y = GCodeParam(line, 'Y').value_or(y);
+        }
+    });
+
+    CHECK(arcs > 0);
+}
+
+static void ExtrusionIsKept() {
+    for (bool relative : {false, true}) {
+        std::string source = MakeLayeredGCode(10, relative);
+        GCodeArcFitStats stats;
+
+        std::string result = GCodeArcFitter::Fit(source, Tolerance, &stats);
+
+        CHECK(stats.Arcs > 0);
+        // Absolute E of an arc is the one of its last move, relative one is a sum rounded to 5 decimals
+        CHECK(std::abs(TotalExtrusion(result) - TotalExtrusion(source)) < (relative ? 1e-5 * stats.Arcs : 1e-9));
+    }
+}
+
+static void EndIsKept() {
+    std::string source = MakeLayeredGCode(10);
+    std::string result = GCodeArcFitter::Fit(source, Tolerance);
+
+    std::vector<std::string_view> source_moves = LinesWith(source, "G1 ");
+    std::vector<std::string_view> result_moves = LinesWith(result, "G1 ");
+
+    CHECK(source_moves.size() && result_moves.size() && source_moves.back() == result_moves.back());
+}
+
+static void StraightLinesAndTravelsAreUntouched() {
+    std::string source = MakeLayeredGCode(10);
+    std::string result = GCodeArcFitter::Fit(source, Tolerance);
+
+    CHECK(LinesWith(result, "; infill") == LinesWith(source, "; infill"));
+    CHECK(LinesWith(result, "F9000") == LinesWith(source, "F9000"));
+    CHECK(LinesWith(result, "Z") == LinesWith(source, "Z"));
+}
+
+static void AnalysisDuringFitting() {
+    std::string source = MakeLayeredGCode(10);
+    GCodeAnalyzer analyzer;
+
+    std::string result = GCodeArcFitter::Fit(source, Tolerance, nullptr, &analyzer, &analyzer);
+    GCodeAnalysis during = analyzer.Finish();
+
+    GCodeAnalysis of_source = GCodeAnalyzer::Analyze(source);
+    GCodeAnalysis of_result = GCodeAnalyzer::Analyze(result);
+
+    CHECK(during.Metadata.Layers == of_source.Metadata.Layers && during.Metadata.Layers == 10);
+    CHECK(during.Metadata.EstimatedPrintTime == of_source.Metadata.EstimatedPrintTime);
+    CHECK(during.RuntimeData.States == of_source.RuntimeData.States);
+    CHECK(during.RuntimeData.States == of_result.RuntimeData.States && during.RuntimeData.Index == of_result.RuntimeData.Index);
+}
+
+int main() {
+    return RunTests({
+        {"PerimetersBecomeArcs", PerimetersBecomeArcs},
+        {"ArcsStayOnPerimeter", ArcsStayOnPerimeter},
+        {"ExtrusionIsKept", ExtrusionIsKept},
+        {"EndIsKept", EndIsKept},
+        {"StraightLinesAndTravelsAreUntouched", StraightLinesAndTravelsAreUntouched},
+        {"AnalysisDuringFitting", AnalysisDuringFitting},
+    });
+}
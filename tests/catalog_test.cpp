@@ -0,0 +1,242 @@
+#include "test.hpp"
+#include "printers/shui/catalog.hpp"
+#include "core/persistence.hpp"
+#include <fstream>
+
+using Files = std::unordered_map<std::string, GCodeFileEntry>;
+using Metadata = std::unordered_map<std::uint64_t, GCodeFileMetadata>;
+
+static std::filesystem::path MakeDataPath(const std::string &name) {
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "printer_proxy_tests" / name;
+
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+
+    return path;
+}
+
+static void WriteRaw(const std::filesystem::path &path, std::string_view content) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(content.data(), content.size());
+}
+
+static Files MakeFiles() {
+    Files files;
+
+    GCodeFileEntry &uploaded = files["BENCHY~1.GCO"];
+    uploaded.LongFilename = "benchy 0.2mm PLA.gcode";
+    uploaded.ContentHash = 0xfedcba9876543210ull;
+    uploaded.HashVersion = 1;
+    uploaded.Transform = {true, 0.05f};
+    uploaded.PreviewSize = 12345;
+    // Percent going back and unknown remaining time make deltas negative
+    uploaded.RuntimeData.States = {
+        {0.f, 0.2f, 1, -1},
+        {12.5f, 0.4f, 2, 95},
+        {10.f, 12.6f, 63, 0},
+    };
+    uploaded.RuntimeData.Index = {12400, 80000, 2147483000};
+
+    // Printer-native file, nothing but the name is known
+    files["OTHER.GCO"];
+
+    return files;
+}
+
+static Metadata MakeMetadata() {
+    Metadata metadata;
+
+    GCodeFileMetadata &benchy = metadata[0xfedcba9876543210ull];
+    benchy.BytesSize = 5'000'000'000;
+    benchy.EstimatedPrintTime = 3723;
+    benchy.Layers = 240;
+    benchy.Height = 48.f;
+    benchy.Toolchanges = 3;
+    benchy.Objects = 2;
+    benchy.EnableSupports = true;
+    benchy.NozzleDiameter = 0.4f;
+    benchy.Previews = {{0, 100}, {100, 4000}};
+
+    GCodeFileMetadata &empty = metadata[1];
+    empty.EstimatedPrintTime = 0;
+
+    return metadata;
+}
+
+static bool operator==(const GCodeFileEntry &left, const GCodeFileEntry &right) {
+    return left.LongFilename == right.LongFilename && left.ContentHash == right.ContentHash && left.HashVersion == right.HashVersion
+        && left.Transform == right.Transform && left.PreviewSize == right.PreviewSize
+        && left.RuntimeData.States == right.RuntimeData.States && left.RuntimeData.Index == right.RuntimeData.Index;
+}
+
+static bool operator==(const GCodeFileMetadata &left, const GCodeFileMetadata &right) {
+    auto SamePreview = [](const GCodePreviewRef &a, const GCodePreviewRef &b) { return a.Offset == b.Offset && a.Size == b.Size; };
+
+    return left.BytesSize == right.BytesSize && left.EstimatedPrintTime == right.EstimatedPrintTime && left.Layers == right.Layers
+        && left.Height == right.Height && left.Toolchanges == right.Toolchanges && left.Objects == right.Objects
+        && left.EnableSupports == right.EnableSupports && left.NozzleDiameter == right.NozzleDiameter
+        && std::equal(left.Previews.begin(), left.Previews.end(), right.Previews.begin(), right.Previews.end(), SamePreview);
+}
+
+static void RoundTrip() {
+    std::filesystem::path data_path = MakeDataPath("round_trip");
+    Files files = MakeFiles();
+    Metadata metadata = MakeMetadata();
+
+    CHECK(ShuiCatalog(data_path).WriteNow(ShuiCatalog(data_path).Serialize(files, metadata)));
+
+    ShuiCatalog catalog(data_path);
+    std::optional<ShuiCatalogContent> content = catalog.Read();
+
+    CHECK(content.has_value());
+
+    if(!content.has_value())
+        return;
+
+    CHECK(content->Files.size() == files.size());
+    CHECK(content->Metadata.size() == metadata.size());
+
+    for (const auto &[_83, entry] : content->Files)
+        CHECK(files.count(_83) && files.at(_83) == entry);
+
+    for (const auto &[content_hash, data] : content->Metadata)
+        CHECK(metadata.count(content_hash) && metadata.at(content_hash) == data);
+}
+
+static void EveryTruncationIsRejected() {
+    std::filesystem::path data_path = MakeDataPath("truncated");
+    std::string serialized = ShuiCatalog(data_path).Serialize(MakeFiles(), MakeMetadata());
+
+    for (std::size_t size = 0; size < serialized.size(); size++) {
+        WriteRaw(data_path / "catalog.bin", std::string_view(serialized).substr(0, size));
+
+        bool rejected = !ShuiCatalog(data_path).Read().has_value();
+
+        CHECK(rejected);
+
+        if(!rejected)
+            std::cerr << "  accepted " << size << " of " << serialized.size() << " bytes\n";
+    }
+}
+
+static void ForeignFormatIsRejected() {
+    std::filesystem::path data_path = MakeDataPath("foreign");
+    std::string serialized = ShuiCatalog(data_path).Serialize(MakeFiles(), MakeMetadata());
+
+    std::string wrong_magic = serialized;
+    wrong_magic[0] ^= 0x20;
+    WriteRaw(data_path / "catalog.bin", wrong_magic);
+    CHECK(!ShuiCatalog(data_path).Read().has_value());
+
+    std::string wrong_version = serialized;
+    wrong_version[4] = char(ShuiCatalog::Version + 1);
+    WriteRaw(data_path / "catalog.bin", wrong_version);
+    CHECK(!ShuiCatalog(data_path).Read().has_value());
+}
+
+static void HugeCountsAreRejected() {
+    std::filesystem::path data_path = MakeDataPath("huge_counts");
+    Files files;
+    files["A.GCO"].LongFilename = "a.gcode";
+    std::string serialized = ShuiCatalog(data_path).Serialize(files, {});
+
+    // Header is 5 u32, entry starts with two strings, u64 hash, i32 hash version, u8, f32 and i32 of transform and preview size
+    std::size_t states_count = 5 * 4 + (4 + 5) + (4 + 7) + 8 + 4 + 1 + 4 + 4;
+
+    for (std::size_t offset : {std::size_t(12), std::size_t(20), states_count, states_count + 4}) {
+        std::string corrupted = serialized;
+        std::memset(corrupted.data() + offset, 0xff, 4);
+        WriteRaw(data_path / "catalog.bin", corrupted);
+
+        CHECK(!ShuiCatalog(data_path).Read().has_value());
+    }
+}
+
+static void FlippedBytesNeverCrash() {
+    std::filesystem::path data_path = MakeDataPath("flipped");
+    std::string serialized = ShuiCatalog(data_path).Serialize(MakeFiles(), MakeMetadata());
+
+    // Whatever is read back has to come from the file, the point is the reader staying inside it
+    for (std::size_t offset = 0; offset < serialized.size(); offset++) {
+        std::string corrupted = serialized;
+        corrupted[offset] = char(~corrupted[offset]);
+        WriteRaw(data_path / "catalog.bin", corrupted);
+
+        ShuiCatalog(data_path).Read();
+    }
+}
+
+static void PreviewReadsStayInsideFile() {
+    std::filesystem::path data_path = MakeDataPath("previews");
+    ShuiCatalog catalog(data_path);
+
+    std::optional<GCodePreviewRef> first = catalog.AppendPreview("first png");
+    std::optional<GCodePreviewRef> second = catalog.AppendPreview("second png");
+
+    CHECK(first.has_value() && second.has_value());
+
+    if(!first.has_value() || !second.has_value())
+        return;
+
+    CHECK(catalog.ReadPreview(first.value()) == std::optional<std::string>("first png"));
+    CHECK(catalog.ReadPreview(second.value()) == std::optional<std::string>("second png"));
+
+    CHECK(!catalog.ReadPreview({second->Offset, second->Size + 1}).has_value());
+    CHECK(!catalog.ReadPreview({-1, 4}).has_value());
+    CHECK(!catalog.ReadPreview({0, std::numeric_limits<std::int64_t>::max()}).has_value());
+}
+
+static void CompactionKeepsReferencedPreviews() {
+    std::filesystem::path data_path = MakeDataPath("compaction");
+    ShuiCatalog catalog(data_path);
+
+    std::string wasted(2 * 1024 * 1024, 'w');
+    std::string kept = "kept png";
+
+    catalog.AppendPreview(wasted);
+    std::optional<GCodePreviewRef> kept_preview = catalog.AppendPreview(kept);
+
+    CHECK(kept_preview.has_value());
+
+    if(!kept_preview.has_value())
+        return;
+
+    Files files;
+    files["KEPT.GCO"].ContentHash = 7;
+    Metadata metadata;
+    metadata[7].Previews = {kept_preview.value()};
+
+    CHECK(catalog.CompactPreviews(files, metadata));
+    CHECK(metadata[7].Previews.size() == 1 && metadata[7].Previews[0].Offset == 0);
+    CHECK(catalog.ReadPreview(metadata[7].Previews[0]) == std::optional<std::string>(kept));
+
+    // Nothing is wasted anymore
+    CHECK(!catalog.CompactPreviews(files, metadata));
+
+    // Catalog written by compaction points to the new previews file
+    ShuiCatalog reloaded(data_path);
+    std::optional<ShuiCatalogContent> content = reloaded.Read();
+
+    CHECK(content.has_value() && content->Metadata.size() == 1);
+
+    if(content.has_value() && content->Metadata.size() == 1)
+        CHECK(reloaded.ReadPreview(content->Metadata[0].second.Previews.at(0)) == std::optional<std::string>(kept));
+}
+
+int main() {
+    Persistence::SetSyncPolicy(PersistenceSyncPolicy::None);
+
+    int result = RunTests({
+        {"RoundTrip", RoundTrip},
+        {"EveryTruncationIsRejected", EveryTruncationIsRejected},
+        {"ForeignFormatIsRejected", ForeignFormatIsRejected},
+        {"HugeCountsAreRejected", HugeCountsAreRejected},
+        {"FlippedBytesNeverCrash", FlippedBytesNeverCrash},
+        {"PreviewReadsStayInsideFile", PreviewReadsStayInsideFile},
+        {"CompactionKeepsReferencedPreviews", CompactionKeepsReferencedPreviews},
+    });
+
+    std::filesystem::remove_all(std::filesystem::temp_directory_path() / "printer_proxy_tests");
+
+    return result;
+}
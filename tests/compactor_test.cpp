@@ -0,0 +1,120 @@
+#include "test.hpp"
+#include "gcode_fixture.hpp"
+#include "printers/shui/compactor.hpp"
+#include "printers/shui/analyzer.hpp"
+
+static constexpr std::string_view Source =
+    "; generated by PrusaSlicer\n"
+    ";SHUI PREVIEW 50x50\n"
+    ";AAAA\n"
+    ";End of SHUI PREVIEW\n"
+    "G90\n"
+    "M82\n"
+    "M73 P0 R12 ; progress\n"
+    "G28 ; home\n"
+    "G92 E0\n"
+    "G1 Z0.2 F7800.000\n"
+    ";Z:0.2\n"
+    "G1 X10.00049 Y20.0001 E0.123456 F1800\n"
+    "G1 X10.0004 Y25 E0.2 F1800\n"
+    "G1 X10 Y25 E0.2\n"
+    "  G1 X12 Y25 E0.3 ; trailing comment\n"
+    "; TYPE:Perimeter\n"
+    "G91\n"
+    "G1 X0 Y5 E0\n"
+    "G90\n"
+    "G1 X12 Y30\n"
+    "G2 X12 Y30 I5 J0 E1.5\n"
+    "M2033.1 L2\n"
+    "M73 P50 R6\n";
+
+// Preview and markers stay, repeated parameters and digits the printer doesn't resolve go,
+// position is forgotten in relative mode and arcs are never touched
+static constexpr std::string_view Compacted =
+    ";SHUI PREVIEW 50x50\n"
+    ";AAAA\n"
+    ";End of SHUI PREVIEW\n"
+    "G90\n"
+    "M82\n"
+    "M73 P0 R12\n"
+    "G28\n"
+    "G92 E0\n"
+    "G1 Z0.2 F7800\n"
+    ";Z:0.2\n"
+    "G1 X10 Y20 E0.12346 F1800\n"
+    "G1 Y25 E0.2\n"
+    "G1 X12 E0.3\n"
+    "G91\n"
+    "G1 Y5\n"
+    "G90\n"
+    "G1 X12 Y30\n"
+    "G2 X12 Y30 I5 J0 E1.5\n"
+    "M2033.1 L2\n"
+    "M73 P50 R6\n";
+
+static bool SameRuntimeData(const GCodeFileRuntimeData &left, const GCodeFileRuntimeData &right) {
+    return left.States == right.States && left.Index == right.Index;
+}
+
+static void FixedFixture() {
+    std::string result = GCodeCompactor::Compact(Source);
+
+    CHECK(result == Compacted);
+
+    if(result != Compacted)
+        std::cerr << result;
+}
+
+static void CompactingTwiceChangesNothing() {
+    std::string once = GCodeCompactor::Compact(MakeLayeredGCode(10));
+
+    CHECK(GCodeCompactor::Compact(once) == once);
+}
+
+static void ExtrusionIsKept() {
+    for (bool relative : {false, true}) {
+        std::string source = MakeLayeredGCode(10, relative);
+        std::string result = GCodeCompactor::Compact(source);
+
+        CHECK(result.size() < source.size());
+        // Every E is rounded to 5 decimals, so the error can only grow by that much per move
+        CHECK(std::abs(TotalExtrusion(result) - TotalExtrusion(source)) < (relative ? 1e-5 * 1400 : 1e-5));
+    }
+}
+
+static void RuntimeStatesAreKept() {
+    std::string source = MakeLayeredGCode(10);
+
+    GCodeAnalysis before = GCodeAnalyzer::Analyze(source);
+    GCodeAnalysis after = GCodeAnalyzer::Analyze(GCodeCompactor::Compact(source));
+
+    CHECK(before.RuntimeData.States.size() > 10);
+    CHECK(before.RuntimeData.States == after.RuntimeData.States);
+}
+
+static void AnalysisDuringCompaction() {
+    std::string source = MakeLayeredGCode(10);
+    GCodeAnalyzer analyzer;
+
+    std::string result = GCodeCompactor::Compact(source, &analyzer, &analyzer);
+    GCodeAnalysis during = analyzer.Finish();
+
+    GCodeAnalysis of_source = GCodeAnalyzer::Analyze(source);
+    GCodeAnalysis of_result = GCodeAnalyzer::Analyze(result);
+
+    // Metadata comes from comments the compactor drops, index has to point into what is uploaded
+    CHECK(during.Metadata.Layers == of_source.Metadata.Layers && during.Metadata.Layers == 10);
+    CHECK(during.Metadata.EstimatedPrintTime == of_source.Metadata.EstimatedPrintTime);
+    CHECK(during.Metadata.NozzleDiameter == of_source.Metadata.NozzleDiameter);
+    CHECK(SameRuntimeData(during.RuntimeData, of_result.RuntimeData));
+}
+
+int main() {
+    return RunTests({
+        {"FixedFixture", FixedFixture},
+        {"CompactingTwiceChangesNothing", CompactingTwiceChangesNothing},
+        {"ExtrusionIsKept", ExtrusionIsKept},
+        {"RuntimeStatesAreKept", RuntimeStatesAreKept},
+        {"AnalysisDuringCompaction", AnalysisDuringCompaction},
+    });
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "pch/std.hpp"
+#include <cmath>
+#include <numbers>
+
+// Deterministic G-code the way slicers lay it out: header comments, per layer progress markers,
+// perimeters as polygons of a circle and a zigzag infill. Extrusion is absolute unless relative_extrusion is set
+inline std::string MakeLayeredGCode(int layers, bool relative_extrusion = false) {
+	std::string gcode;
+	char line[160];
+
+	gcode += "; generated by fixture\n";
+	gcode += "; total layer number: " + std::to_string(layers) + "\n";
+	gcode += "; nozzle_diameter = 0.4\n";
+	gcode += "G90\n";
+	gcode += relative_extrusion ? "M83\n" : "M82\n";
+	gcode += "G28 ; home all\n";
+	gcode += "G92 E0\n";
+
+	double e = 0;
+	auto Extrude = [&e, relative_extrusion](double amount) {
+		e += amount;
+		return relative_extrusion ? amount : e;
+	};
+
+	for (int layer = 0; layer < layers; layer++) {
+		std::snprintf(line, sizeof(line), "M73 P%d R%d\n;Z:%.1f\nM2033.1 L%d\nG1 Z%.3f F7800.000\n", layer * 100 / layers, layers - layer, (layer + 1) * 0.2, layer + 1, (layer + 1) * 0.2);
+		gcode += line;
+
+		// Perimeter, a polygon of 120 sides on a circle, a bit short of closing it
+		const double cx = 100, cy = 100, r = 20 + layer % 3;
+		double px = cx + r, py = cy;
+
+		std::snprintf(line, sizeof(line), "G1 X%.3f Y%.3f F9000.000\n; TYPE:Perimeter\nG1 F1800\n", px, py);
+		gcode += line;
+
+		for (int i = 1; i < 118; i++) {
+			double angle = i * 2 * std::numbers::pi / 120;
+			double x = cx + r * std::cos(angle), y = cy + r * std::sin(angle);
+
+			std::snprintf(line, sizeof(line), "G1 X%.3f Y%.3f E%.5f\n", x, y, Extrude(std::hypot(x - px, y - py) * 0.04));
+			gcode += line;
+
+			px = x;
+			py = y;
+		}
+
+		// Infill, straight lines only
+		gcode += "; TYPE:Solid infill\n";
+		for (int i = 0; i < 20; i++) {
+			double x = 90 + i, y = i % 2 ? 110 : 90;
+
+			std::snprintf(line, sizeof(line), "G1 X%.3f Y%.3f E%.5f ; infill\n", x, y, Extrude(std::hypot(x - px, y - py) * 0.04));
+			gcode += line;
+
+			px = x;
+			py = y;
+		}
+	}
+
+	gcode += "; estimated printing time (normal mode) = 1h 2m 3s\n";
+
+	return gcode;
+}
+
+// Value of a parameter of a G-code line, comment excluded
+inline std::optional<double> GCodeParam(std::string_view line, char name) {
+	line = line.substr(0, line.find(';'));
+
+	for (std::size_t position = line.find(' '); position != std::string_view::npos; position = line.find(' ', position + 1)) {
+		if (position + 1 < line.size() && line[position + 1] == name)
+			return std::strtod(std::string(line.substr(position + 2, line.find(' ', position + 1) - position - 2)).c_str(), nullptr);
+	}
+
+	return std::nullopt;
+}
+
+// Calls back with every line, separator excluded
+template<typename Callback>
+void ForEachLine(std::string_view content, Callback callback) {
+	while (content.size()) {
+		auto separator = content.find('\n');
+		callback(content.substr(0, separator));
+		content.remove_prefix(separator == std::string_view::npos ? content.size() : separator + 1);
+	}
+}
+
+// Total filament pushed by the file, whichever extrusion mode it uses
+inline double TotalExtrusion(std::string_view gcode) {
+	bool relative = false;
+	double total = 0, last = 0;
+
+	ForEachLine(gcode, [&](std::string_view line) {
+		if(line.starts_with("M83"))
+			relative = true;
+		if(line.starts_with("M82"))
+			relative = false;
+		if(line.starts_with("G92"))
+			last = GCodeParam(line, 'E').value_or(0);
+
+		if(!line.starts_with("G1 ") && !line.starts_with("G2 ") && !line.starts_with("G3 "))
+			return;
+
+		if (std::optional<double> e = GCodeParam(line, 'E')) {
+			total += relative ? e.value() : e.value() - last;
+			last = relative ? last : e.value();
+		}
+	});
+
+	return total;
+}
@@ -0,0 +1,96 @@
+#include "test.hpp"
+#include "core/image.hpp"
+#include "core/base64.hpp"
+#include <boost/endian/conversion.hpp>
+#include <random>
+
+// Conversion as it was before ToSHUI was made to work on whole rows, kept as the reference output
+static std::uint16_t ToRGB565(std::uint32_t rgba) {
+    std::uint8_t b = (rgba >> 16) & 0xFF;
+    std::uint8_t g = (rgba >> 8) & 0xFF;
+    std::uint8_t r = rgba & 0xFF;
+
+    std::uint16_t r5 = (r >> 3) & 0x1F;
+    std::uint16_t g6 = (g >> 2) & 0x3F;
+    std::uint16_t b5 = (b >> 3) & 0x1F;
+
+    return (r5 << 11) | (g6 << 5) | b5;
+}
+
+static std::string ReferenceToSHUI(const Image &image) {
+    std::string result;
+    for (int y = 0; y < image.Height(); y++) {
+        std::string row;
+
+        for (int x = 0; x < image.Width(); x++) {
+            std::uint16_t rgb565 = boost::endian::native_to_big(ToRGB565(image.Get(x, y)));
+
+            row.append((const char*)&rgb565, 2);
+        }
+
+        result += ";" + Base64::Encode(row) + "\n";
+    }
+    return result;
+}
+
+static Image MakeImage(std::int32_t width, std::int32_t height, std::uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<std::uint32_t> pixels(width * height);
+
+    for(std::uint32_t &pixel: pixels)
+        pixel = random();
+
+    return Image(width, height, std::move(pixels));
+}
+
+template<typename Function>
+static double MicrosecondsPerCall(Function function, int calls) {
+    std::size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for(int i = 0; i < calls; i++)
+        sink += function().size();
+
+    auto took = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    // Keeps the calls from being optimized out
+    if(!sink)
+        std::cerr << "  nothing was converted\n";
+
+    return took / calls;
+}
+
+static void SameBytesAsReference() {
+    // Odd widths leave a tail for the vector part of the conversion and a base64 padding on every line
+    for (std::int32_t size : {1, 2, 3, 7, 8, 9, 15, 16, 17, 37, 50, 100, 200, 300}) {
+        Image image = MakeImage(size, size / 2 + 1, size);
+
+        bool same = image.ToSHUI() == ReferenceToSHUI(image);
+
+        CHECK(same);
+
+        if(!same)
+            std::cerr << "  differs at " << size << "x" << size / 2 + 1 << "\n";
+    }
+
+    CHECK(Image().ToSHUI().empty());
+}
+
+static void Timings() {
+    for (std::int32_t size : {50, 100, 200, 300}) {
+        Image image = MakeImage(size, size, 1);
+        int calls = std::max(4'000'000 / (size * size), 10);
+
+        double reference = MicrosecondsPerCall([&image]() { return ReferenceToSHUI(image); }, calls);
+        double current = MicrosecondsPerCall([&image]() { return image.ToSHUI(); }, calls);
+
+        std::cout << "  " << size << "x" << size << ": reference " << reference << " us, current " << current << " us, x" << reference / current << "\n";
+    }
+}
+
+int main() {
+    return RunTests({
+        {"SameBytesAsReference", SameBytesAsReference},
+        {"Timings", Timings},
+    });
+}
@@ -0,0 +1,168 @@
+#include "test.hpp"
+#include "interfaces/multipart.hpp"
+
+static constexpr std::string_view Boundary = "----Boundary7MA4YWxkTrZu0gW";
+
+struct ParsedPart {
+    MultipartParser::Headers Headers;
+    std::string Data;
+    bool Ended = false;
+};
+
+struct ParseResult {
+    std::vector<ParsedPart> Parts;
+    bool Ok = true;
+    bool Done = false;
+};
+
+// Body as a slicer sends it, data of the file part looks a lot like a delimiter on purpose
+static std::string MakeBody() {
+    std::string body;
+    body += "preamble is ignored\r\n";
+    body += "--" + std::string(Boundary) + "\r\n";
+    body += "Content-Disposition: form-data; name=\"print\"\r\n\r\n";
+    body += "true";
+    body += "\r\n--" + std::string(Boundary) + "\r\n";
+    body += "Content-Disposition: form-data; name=\"file\"; filename=\"part; v2.gcode\"\r\n";
+    body += "Content-Type: application/octet-stream\r\n\r\n";
+    body += "G28\r\n--not a boundary\r\n--" + std::string(Boundary.substr(0, 10)) + "\nG1 X10\n";
+    body += "\r\n--" + std::string(Boundary) + "--\r\n";
+    body += "epilogue is ignored too";
+    return body;
+}
+
+static ParseResult Parse(const std::vector<std::string_view> &chunks) {
+    ParseResult result;
+    MultipartParser parser(Boundary);
+
+    parser.OnPartBegin = [&result](const MultipartParser::Headers &headers) {
+        result.Parts.push_back({headers});
+    };
+    parser.OnPartData = [&result](std::string_view data) {
+        result.Parts.back().Data.append(data);
+    };
+    parser.OnPartEnd = [&result]() {
+        result.Parts.back().Ended = true;
+    };
+
+    for (std::string_view chunk : chunks) {
+        if(!parser.Feed(chunk))
+            result.Ok = false;
+    }
+
+    result.Done = parser.IsDone();
+    return result;
+}
+
+static bool IsExpected(const ParseResult &result) {
+    if(!result.Ok || !result.Done || result.Parts.size() != 2)
+        return false;
+
+    const ParsedPart &print = result.Parts[0];
+    const ParsedPart &file = result.Parts[1];
+
+    return print.Ended && print.Headers.at("name") == "print" && print.Data == "true"
+        && file.Ended && file.Headers.at("name") == "file" && file.Headers.at("filename") == "part; v2.gcode"
+        && file.Data == "G28\r\n--not a boundary\r\n--" + std::string(Boundary.substr(0, 10)) + "\nG1 X10\n";
+}
+
+static void WholeBody() {
+    std::string body = MakeBody();
+
+    CHECK(IsExpected(Parse({body})));
+}
+
+static void SplitAtEveryPosition() {
+    std::string body = MakeBody();
+    std::string_view view = body;
+
+    for (std::size_t split = 0; split <= body.size(); split++) {
+        bool expected = IsExpected(Parse({view.substr(0, split), view.substr(split)}));
+
+        CHECK(expected);
+
+        if(!expected)
+            std::cerr << "  split at " << split << "\n";
+    }
+}
+
+static void ChunksOfEverySize() {
+    std::string body = MakeBody();
+    std::string_view view = body;
+
+    for (std::size_t size = 1; size <= 64; size++) {
+        std::vector<std::string_view> chunks;
+
+        for(std::size_t offset = 0; offset < view.size(); offset += size)
+            chunks.push_back(view.substr(offset, size));
+
+        bool expected = IsExpected(Parse(chunks));
+
+        CHECK(expected);
+
+        if(!expected)
+            std::cerr << "  chunk size " << size << "\n";
+    }
+}
+
+static void BodyWithoutPreamble() {
+    std::string body = MakeBody();
+    body.erase(0, body.find("--"));
+
+    CHECK(IsExpected(Parse({body})));
+}
+
+static void GarbageAfterBoundary() {
+    std::string body = "--" + std::string(Boundary) + "xx\r\n";
+
+    CHECK(!Parse({body}).Ok);
+}
+
+static void EndlessHeaders() {
+    std::string body = "--" + std::string(Boundary) + "\r\nContent-Disposition: form-data; name=\"file\"\r\n";
+    std::string filler(64 * 1024, 'x');
+
+    ParseResult result = Parse({body, filler});
+
+    CHECK(!result.Ok);
+    CHECK(result.Parts.empty());
+}
+
+static void UnfinishedBody() {
+    std::string body = MakeBody();
+    body.resize(body.find(std::string(Boundary) + "--"));
+
+    ParseResult result = Parse({body});
+
+    CHECK(result.Ok);
+    CHECK(!result.Done);
+    CHECK(result.Parts.size() == 2 && !result.Parts[1].Ended);
+}
+
+static void ExtractBoundary() {
+    CHECK(MultipartParser::ExtractBoundary("multipart/form-data; boundary=abc") == "abc");
+    CHECK(MultipartParser::ExtractBoundary("multipart/form-data; boundary=\"a b\"; charset=utf-8") == "a b");
+    CHECK(MultipartParser::ExtractBoundary("application/json").empty());
+}
+
+static void ParseHeaders() {
+    MultipartParser::Headers headers = MultipartParser::ParseHeaders("Content-Disposition: form-data; name=\"file\"; filename=\"a;b=c.gcode\"\r\nContent-Type: text/plain");
+
+    CHECK(headers.size() == 2);
+    CHECK(headers["name"] == "file");
+    CHECK(headers["filename"] == "a;b=c.gcode");
+}
+
+int main() {
+    return RunTests({
+        {"WholeBody", WholeBody},
+        {"SplitAtEveryPosition", SplitAtEveryPosition},
+        {"ChunksOfEverySize", ChunksOfEverySize},
+        {"BodyWithoutPreamble", BodyWithoutPreamble},
+        {"GarbageAfterBoundary", GarbageAfterBoundary},
+        {"EndlessHeaders", EndlessHeaders},
+        {"UnfinishedBody", UnfinishedBody},
+        {"ExtractBoundary", ExtractBoundary},
+        {"ParseHeaders", ParseHeaders},
+    });
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "pch/std.hpp"
+#include <iostream>
+
+// Just enough for logic tests: failed checks are reported and counted, RunTests turns them into the exit code
+
+inline int &TestFailures() {
+	static int s_Failures = 0;
+	return s_Failures;
+}
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+			TestFailures()++; \
+		} \
+	} while (0)
+
+using TestCase = std::pair<const char *, void(*)()>;
+
+inline int RunTests(std::initializer_list<TestCase> tests) {
+	for (const auto &[name, test] : tests) {
+		int failures = TestFailures();
+
+		test();
+
+		std::cout << (TestFailures() == failures ? "[ OK ] " : "[FAIL] ") << name << "\n";
+	}
+
+	return TestFailures() ? 1 : 0;
+}
@@ -0,0 +1,6 @@
+#include <bsl/log.hpp>
+
+// Tests have no Telegram logger, everything goes to the console
+void LogFunctionExternal(const std::string& category, Verbosity verbosity, const std::string& message) {
+    Println("[%][%]: %", category, verbosity, message);
+}